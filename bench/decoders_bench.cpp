@@ -0,0 +1,577 @@
+/*
+ * Microbenchmarks of the blackbox decoders on synthetic data shaped like logged field deltas. Each decoder is timed on
+ * its fast path, decoding through a stream over one buffer, against a reference decoder that reads a byte or a bit at
+ * a time as the stream used to.
+ *
+ * Not built by default: "catkin_make decoders_bench", then run devel/lib/fcu_io/decoders_bench. Each line reports the
+ * best of several runs in ns per value, and whether both decoders decoded the same.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include <blackbox/decoders.h>
+#include <blackbox/parser_input_stream.h>
+#include <blackbox/tools.h>
+
+#include "../test/blackbox_encoders.h"
+
+using blackbox_test::LogWriter;
+
+#define BENCH_VALUES 1000000
+#define BENCH_RUNS 7
+
+namespace {
+
+/**
+ * Reads a byte at a time, and bits one at a time out of the current byte, checking for the end of the data as it goes,
+ * as the stream did before its bit reservoir and the decoders' fast paths.
+ */
+class ReferenceReader {
+public:
+	explicit ReferenceReader(const std::string &data) :
+			pos_((const uint8_t*) data.data()), end_(pos_ + data.size()), bitPos_(7) {
+	}
+
+	int readByte() {
+		return pos_ < end_ ? *pos_++ : EOF;
+	}
+
+	uint32_t readBits(int numBits) {
+		uint32_t result = 0;
+
+		if (pos_ + (numBits + 7) / 8 > end_)
+			return EOF;
+
+		while (numBits > 0) {
+			result |= ((*pos_ >> bitPos_) & 0x01) << (numBits - 1);
+
+			if (bitPos_ == 0) {
+				pos_++;
+				bitPos_ = 7;
+			} else {
+				bitPos_--;
+			}
+			numBits--;
+		}
+
+		return result;
+	}
+
+	void byteAlign() {
+		if (bitPos_ != 7) {
+			bitPos_ = 7;
+			pos_++;
+		}
+	}
+
+	uint32_t readUnsignedVB() {
+		uint32_t result = 0;
+
+		for (int i = 0, shift = 0; i < 5; i++, shift += 7) {
+			const int c = readByte();
+
+			if (c == EOF)
+				return 0;
+
+			result |= (c & ~0x80) << shift;
+
+			if (c < 128)
+				return result;
+		}
+
+		return 0;
+	}
+
+	int32_t readSignedVB() {
+		return zigzagDecode(readUnsignedVB());
+	}
+
+	uint32_t readEliasDeltaU32() {
+		int lengthValBits = 0;
+
+		while (lengthValBits <= 32 && readBits(1) == 0)
+			lengthValBits++;
+
+		const uint32_t length = ((1 << lengthValBits) | readBits(lengthValBits)) - 1;
+		const uint32_t result = (1 << length) | readBits(length);
+
+		if (result == 0xFFFFFFFF)
+			return readBits(1) ? 0xFFFFFFFF : 0xFFFFFFFF - 1;
+
+		return result - 1;
+	}
+
+	uint32_t readEliasGammaU32() {
+		int valBits = 0;
+
+		while (valBits <= 32 && readBits(1) == 0)
+			valBits++;
+
+		const uint32_t result = (1 << (valBits - 1)) | readBits(valBits - 1);
+
+		if (result == 0xFFFFFFFF)
+			return readBits(1) ? 0xFFFFFFFF : 0xFFFFFFFF - 1;
+
+		return result - 1;
+	}
+
+	void readTag2_3S32(int32_t *values) {
+		uint8_t leadByte = readByte();
+
+		switch (leadByte >> 6) {
+		case 0:
+			values[0] = signExtend2Bit((leadByte >> 4) & 0x03);
+			values[1] = signExtend2Bit((leadByte >> 2) & 0x03);
+			values[2] = signExtend2Bit(leadByte & 0x03);
+			break;
+		case 1:
+			values[0] = signExtend4Bit(leadByte & 0x0F);
+			leadByte = readByte();
+			values[1] = signExtend4Bit(leadByte >> 4);
+			values[2] = signExtend4Bit(leadByte & 0x0F);
+			break;
+		case 2:
+			values[0] = signExtend6Bit(leadByte & 0x3F);
+			values[1] = signExtend6Bit(readByte() & 0x3F);
+			values[2] = signExtend6Bit(readByte() & 0x3F);
+			break;
+		case 3:
+			for (int i = 0; i < 3; i++, leadByte >>= 2) {
+				uint32_t value = 0;
+
+				for (int b = 0; b <= (leadByte & 0x03); b++)
+					value |= (uint32_t) readByte() << (b * 8);
+
+				switch (leadByte & 0x03) {
+				case 0:
+					values[i] = (int8_t) value;
+					break;
+				case 1:
+					values[i] = (int16_t) value;
+					break;
+				case 2:
+					values[i] = signExtend24Bit(value);
+					break;
+				case 3:
+					values[i] = (int32_t) value;
+					break;
+				}
+			}
+			break;
+		}
+	}
+
+	void readTag8_4S16_v1(int32_t *values) {
+		uint8_t selector = readByte();
+
+		for (int i = 0; i < 4; i++, selector >>= 2) {
+			switch (selector & 0x03) {
+			case 0:
+				values[i] = 0;
+				break;
+			case 1: {
+				const uint8_t combined = readByte();
+
+				values[i] = signExtend4Bit(combined & 0x0F);
+				values[++i] = signExtend4Bit(combined >> 4);
+				selector >>= 2;
+				break;
+			}
+			case 2:
+				values[i] = (int8_t) readByte();
+				break;
+			case 3: {
+				const uint8_t low = readByte();
+
+				values[i] = (int16_t) (low | (readByte() << 8));
+				break;
+			}
+			}
+		}
+	}
+
+	void readTag8_4S16_v2(int32_t *values) {
+		uint8_t selector = readByte();
+		uint8_t buffer = 0;
+		bool nibble = false;
+
+		for (int i = 0; i < 4; i++, selector >>= 2) {
+			switch (selector & 0x03) {
+			case 0:
+				values[i] = 0;
+				break;
+			case 1:
+				if (!nibble) {
+					buffer = readByte();
+					values[i] = signExtend4Bit(buffer >> 4);
+				} else {
+					values[i] = signExtend4Bit(buffer & 0x0F);
+				}
+				nibble = !nibble;
+				break;
+			case 2:
+				if (!nibble) {
+					values[i] = (int8_t) readByte();
+				} else {
+					const uint8_t high = buffer << 4;
+
+					buffer = readByte();
+					values[i] = (int8_t) (high | buffer >> 4);
+				}
+				break;
+			case 3:
+				if (!nibble) {
+					const uint8_t high = readByte();
+
+					values[i] = (int16_t) (high << 8 | readByte());
+				} else {
+					// The low nibble of the last byte, one whole byte, then the high nibble of the next
+					const uint8_t middle = readByte();
+					const uint8_t low = readByte();
+
+					values[i] = (int16_t) (uint16_t) (buffer << 12 | middle << 4 | low >> 4);
+					buffer = low;
+				}
+				break;
+			}
+		}
+	}
+
+	void readTag8_8SVB(int32_t *values) {
+		uint8_t header = readByte();
+
+		for (int i = 0; i < 8; i++, header >>= 1)
+			values[i] = (header & 0x01) ? readSignedVB() : 0;
+	}
+
+private:
+	const uint8_t *pos_;
+	const uint8_t *end_;
+	int bitPos_;
+};
+
+uint64_t nowNs() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Random field deltas: mostly within a few units, sometimes within a few hundred, now and then anything.
+ */
+class DeltaValues {
+public:
+	DeltaValues() :
+			state_(2463534242U) {
+	}
+
+	uint32_t next() {
+		state_ ^= state_ << 13;
+		state_ ^= state_ >> 17;
+		state_ ^= state_ << 5;
+
+		return state_;
+	}
+
+	int32_t nextDelta() {
+		const uint32_t kind = next() % 100;
+		const int32_t value = (int32_t) next();
+
+		if (kind < 70)
+			return value % 8;
+		if (kind < 97)
+			return value % 500;
+
+		return value;
+	}
+
+private:
+	uint32_t state_;
+};
+
+/**
+ * One benchmark: decodes all of the data its way, both with the reference decoders and with the stream's.
+ */
+class Bench {
+public:
+	virtual ~Bench() {
+	}
+
+	virtual const char* name() const = 0;
+
+	virtual int valueCount() const = 0;
+
+	virtual uint32_t decodeReference(const std::string &data) const = 0;
+
+	virtual uint32_t decodeFast(blackbox::ParserInputStream &pis) const = 0;
+};
+
+/**
+ * The best time per value of the decoding over BENCH_RUNS runs, and the sum of what it decoded in *sum.
+ */
+double bestNsPerValue(const Bench &bench, const std::string &data, bool fast, uint32_t *sum) {
+	uint64_t best = UINT64_MAX;
+
+	for (int run = 0; run < BENCH_RUNS; run++) {
+		const uint64_t start = nowNs();
+
+		if (fast) {
+			blackbox::ParserInputStream pis((const uint8_t*) data.data(), data.size());
+
+			*sum = bench.decodeFast(pis);
+		} else {
+			*sum = bench.decodeReference(data);
+		}
+
+		const uint64_t elapsed = nowNs() - start;
+
+		if (elapsed < best)
+			best = elapsed;
+	}
+
+	return (double) best / bench.valueCount();
+}
+
+/**
+ * Time both decoders, returns false if they didn't decode the same values.
+ */
+bool runBench(const Bench &bench, const std::string &data) {
+	uint32_t referenceSum, fastSum;
+	const double reference = bestNsPerValue(bench, data, false, &referenceSum);
+	const double fast = bestNsPerValue(bench, data, true, &fastSum);
+
+	printf("%-16s %8.2f %8.2f %7.2fx%s\n", bench.name(), reference, fast, reference / fast, referenceSum == fastSum ? "" : "  MISMATCH");
+
+	return referenceSum == fastSum;
+}
+
+class BitsBench: public Bench {
+public:
+	explicit BitsBench(const std::vector<int> &widths) :
+			widths_(widths) {
+	}
+
+	const char* name() const {
+		return "bits";
+	}
+
+	int valueCount() const {
+		return widths_.size();
+	}
+
+	uint32_t decodeReference(const std::string &data) const {
+		ReferenceReader reader(data);
+		uint32_t sum = 0;
+
+		for (size_t i = 0; i < widths_.size(); i++)
+			sum += reader.readBits(widths_[i]);
+
+		return sum;
+	}
+
+	uint32_t decodeFast(blackbox::ParserInputStream &pis) const {
+		uint32_t sum = 0;
+
+		for (size_t i = 0; i < widths_.size(); i++)
+			sum += pis.streamReadBits(widths_[i]);
+
+		return sum;
+	}
+
+private:
+	const std::vector<int> &widths_;
+};
+
+class SignedVBBench: public Bench {
+public:
+	const char* name() const {
+		return "signed VB";
+	}
+
+	int valueCount() const {
+		return BENCH_VALUES;
+	}
+
+	uint32_t decodeReference(const std::string &data) const {
+		ReferenceReader reader(data);
+		uint32_t sum = 0;
+
+		for (int i = 0; i < BENCH_VALUES; i++)
+			sum += reader.readSignedVB();
+
+		return sum;
+	}
+
+	uint32_t decodeFast(blackbox::ParserInputStream &pis) const {
+		uint32_t sum = 0;
+
+		for (int i = 0; i < BENCH_VALUES; i++)
+			sum += pis.streamReadSignedVB();
+
+		return sum;
+	}
+};
+
+class EliasBench: public Bench {
+public:
+	explicit EliasBench(bool gamma) :
+			gamma_(gamma) {
+	}
+
+	const char* name() const {
+		return gamma_ ? "Elias gamma" : "Elias delta";
+	}
+
+	int valueCount() const {
+		return BENCH_VALUES;
+	}
+
+	uint32_t decodeReference(const std::string &data) const {
+		ReferenceReader reader(data);
+		uint32_t sum = 0;
+
+		for (int i = 0; i < BENCH_VALUES; i++)
+			sum += zigzagDecode(gamma_ ? reader.readEliasGammaU32() : reader.readEliasDeltaU32());
+
+		return sum;
+	}
+
+	uint32_t decodeFast(blackbox::ParserInputStream &pis) const {
+		uint32_t sum = 0;
+
+		for (int i = 0; i < BENCH_VALUES; i++)
+			sum += gamma_ ? streamReadEliasGammaS32(pis) : streamReadEliasDeltaS32(pis);
+
+		return sum;
+	}
+
+private:
+	bool gamma_;
+};
+
+typedef void (ReferenceReader::*ReferenceGroupDecoder)(int32_t *values);
+typedef void (*GroupDecoder)(blackbox::ParserInputStream &pis, int32_t *values);
+
+class GroupBench: public Bench {
+public:
+	GroupBench(const char *name, int groupSize, ReferenceGroupDecoder reference, GroupDecoder fast) :
+			name_(name), groupSize_(groupSize), reference_(reference), fast_(fast) {
+	}
+
+	const char* name() const {
+		return name_;
+	}
+
+	int valueCount() const {
+		return BENCH_VALUES;
+	}
+
+	uint32_t sumGroup(const int32_t *values) const {
+		uint32_t sum = 0;
+
+		for (int i = 0; i < groupSize_; i++)
+			sum += values[i] * (i + 1);
+
+		return sum;
+	}
+
+	uint32_t decodeReference(const std::string &data) const {
+		ReferenceReader reader(data);
+		int32_t values[8];
+		uint32_t sum = 0;
+
+		for (int i = 0; i < BENCH_VALUES; i += groupSize_) {
+			(reader.*reference_)(values);
+			sum += sumGroup(values);
+		}
+
+		return sum;
+	}
+
+	uint32_t decodeFast(blackbox::ParserInputStream &pis) const {
+		int32_t values[8];
+		uint32_t sum = 0;
+
+		for (int i = 0; i < BENCH_VALUES; i += groupSize_) {
+			fast_(pis, values);
+			sum += sumGroup(values);
+		}
+
+		return sum;
+	}
+
+private:
+	const char *name_;
+	int groupSize_;
+	ReferenceGroupDecoder reference_;
+	GroupDecoder fast_;
+};
+
+void readTag8_8SVB(blackbox::ParserInputStream &pis, int32_t *values) {
+	streamReadTag8_8SVB(pis, values, 8);
+}
+
+}
+
+int main() {
+	DeltaValues values;
+	std::vector<int> widths;
+	LogWriter bits, signedVB, eliasDelta, eliasGamma, tag2_3S32, tag8_4S16_v1, tag8_4S16_v2, tag8_8SVB;
+
+	for (int i = 0; i < BENCH_VALUES; i++) {
+		const int32_t delta = values.nextDelta();
+		const int width = 1 + values.next() % 16;
+
+		widths.push_back(width);
+		bits.writeBits(values.next(), width);
+
+		signedVB.writeSignedVB(delta);
+		eliasDelta.writeEliasDeltaS32(delta);
+		eliasGamma.writeEliasGammaS32(delta);
+	}
+
+	// Groups of deltas, those of TAG8_4S16 limited to its 16 bits
+	for (int i = 0; i < BENCH_VALUES; i += 24) {
+		int32_t group[24];
+
+		for (int j = 0; j < 24; j++)
+			group[j] = values.nextDelta();
+
+		for (int j = 0; j < 24; j += 3)
+			tag2_3S32.writeTag2_3S32(&group[j]);
+
+		for (int j = 0; j < 24; j += 8)
+			tag8_8SVB.writeTag8_8SVB(&group[j], 8);
+
+		for (int j = 0; j < 24; j++)
+			group[j] = (int16_t) group[j];
+
+		for (int j = 0; j < 24; j += 4) {
+			tag8_4S16_v1.writeTag8_4S16_v1(&group[j]);
+			tag8_4S16_v2.writeTag8_4S16_v2(&group[j]);
+		}
+	}
+
+	bits.byteAlign();
+	eliasDelta.byteAlign();
+	eliasGamma.byteAlign();
+
+	printf("%-16s %8s %8s %8s\n", "ns/value", "ref", "fast", "speedup");
+
+	bool same = runBench(BitsBench(widths), bits.data());
+	same = runBench(SignedVBBench(), signedVB.data()) && same;
+	same = runBench(EliasBench(false), eliasDelta.data()) && same;
+	same = runBench(EliasBench(true), eliasGamma.data()) && same;
+	same = runBench(GroupBench("TAG2_3S32", 3, &ReferenceReader::readTag2_3S32, streamReadTag2_3S32), tag2_3S32.data()) && same;
+	same = runBench(GroupBench("TAG8_4S16 v1", 4, &ReferenceReader::readTag8_4S16_v1, streamReadTag8_4S16_v1), tag8_4S16_v1.data()) && same;
+	same = runBench(GroupBench("TAG8_4S16 v2", 4, &ReferenceReader::readTag8_4S16_v2, streamReadTag8_4S16_v2), tag8_4S16_v2.data()) && same;
+	same = runBench(GroupBench("TAG8_8SVB", 8, &ReferenceReader::readTag8_8SVB, readTag8_8SVB), tag8_8SVB.data()) && same;
+
+	return same ? 0 : 1;
+}
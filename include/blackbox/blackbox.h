@@ -7,8 +7,9 @@
 #define BLACKBOX_BLACKBOX_H
 
 #include <blackbox/blackbox_listener.h>
-#include <blackbox/serial.h>
+#include <blackbox/transport.h>
 #include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <stdint.h>
 #include <string>
@@ -17,16 +18,37 @@ namespace blackbox {
 
 class Blackbox : public SerialListener {
 public:
-	Blackbox(std::string port, int baud_rate, BlackboxListener * const listener);
+	/**
+	 * \param options Selects the transport (serial, pty, udp, tcp or file replay) and its settings
+	 * \param listener Receives the blackbox data
+	 * \throws SerialException if the transport can't be opened
+	 */
+	Blackbox(const TransportOptions &options, BlackboxListener * const listener);
 
 	~Blackbox();
 
-	void serial_data_received(const uint8_t byte);
+	using SerialListener::serial_data_received;
+
+	void serial_data_received(const uint8_t * const data, const size_t length, const uint64_t rx_time_us);
+
+	void serial_connection_changed(const ConnectionState state, const ConnectionStats &stats);
 
 	void serial_data_send(float roll, float pitch, float yaw, float trottle);
+
+	TransportStats transport_stats() {
+		return transport_->stats();
+	}
+
+	ConnectionState connection_state() {
+		return transport_->connection_state();
+	}
+
+	ConnectionStats connection_stats() {
+		return transport_->connection_stats();
+	}
 private:
-	Serial serial_;
 	BlackboxListener* listener_;
+	boost::scoped_ptr<Transport> transport_;
 };
 
 }
@@ -1,11 +1,37 @@
 #ifndef BLACKBOX_LISTENER_H
 #define BLACKBOX_LISTENER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <blackbox/connection_state.h>
+#include <blackbox/monotonic_time.h>
+
 namespace blackbox {
 
 class BlackboxListener {
 public:
-	virtual void handle_blackbox_message(const uint8_t byte) = 0;
+	/**
+	 * \brief Called with each chunk of blackbox data as it arrives
+	 * \param data Received bytes, only valid for the duration of the call
+	 * \param length Number of bytes at data
+	 * \param rx_time_us CLOCK_MONOTONIC time (us) at which the chunk was read
+	 */
+	virtual void handle_blackbox_message(const uint8_t * const data, const size_t length, const uint64_t rx_time_us) = 0;
+
+	/**
+	 * \brief Per-byte compatibility shim, forwards a one byte chunk stamped with the current time
+	 */
+	virtual void handle_blackbox_message(const uint8_t byte) {
+		handle_blackbox_message(&byte, 1, monotonic_time_us());
+	}
+
+	/**
+	 * \brief Called when the link to the flight controller goes down or comes back, in order with the data
+	 */
+	virtual void handle_connection_changed(const ConnectionState state, const ConnectionStats &stats) {
+	}
+
 	virtual ~BlackboxListener() {
 	}
 	;
@@ -0,0 +1,147 @@
+#ifndef BLACKBOX_CLOCK_SYNC_H
+#define BLACKBOX_CLOCK_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Number of buckets in the regression window and the span of FC time each one covers
+#define CLOCK_SYNC_WINDOW 256
+#define CLOCK_SYNC_BUCKET_US 50000
+// Buckets needed before the drift is estimated, until then the clocks are assumed to run at the same rate
+#define CLOCK_SYNC_MIN_SAMPLES 8
+#define CLOCK_SYNC_MAX_DRIFT_PPM 1000.0
+// Residuals inside this band are never treated as outliers, whatever the current jitter estimate
+#define CLOCK_SYNC_MIN_REJECT_US 2000.0
+#define CLOCK_SYNC_REJECT_SIGMA 4.0
+// After this many rejected samples in a row the model is assumed stale (FC reboot, link stall) and re-seeded
+#define CLOCK_SYNC_MAX_CONSECUTIVE_REJECTS 64
+
+namespace blackbox {
+
+/**
+ * \brief Online estimate of the mapping from flight controller time to host monotonic time
+ *
+ * Fed with (FC time, host arrival time) pairs, one per main frame. Transport latency only ever delays a sample, so
+ * only the fastest sample of each CLOCK_SYNC_BUCKET_US of FC time is kept, and the model is a least squares fit
+ * through the last CLOCK_SYNC_WINDOW of those. Samples that land far off the current model are rejected before
+ * they reach a bucket, so that buffered bursts do not drag the estimate.
+ *
+ * The FC clock keeps running while logging is paused, so a forward jump in FC time (LOGGING_RESUME, dropped frames)
+ * leaves the model intact. The 32-bit FC time is unwrapped internally; if it runs backwards the FC has restarted
+ * and the estimator starts over.
+ */
+class ClockSync {
+public:
+	explicit ClockSync(size_t window = CLOCK_SYNC_WINDOW);
+
+	/**
+	 * \brief Forget all samples and the current model
+	 */
+	void reset();
+
+	/**
+	 * \brief Add a sample
+	 * \return false if the sample was rejected as an outlier
+	 */
+	bool add_sample(const uint32_t fc_time_us, const uint64_t host_time_us);
+
+	/**
+	 * \brief Logging resumed at fc_time_us after a pause
+	 *
+	 * Only advances the FC time unwrapping, the model carries on across the gap.
+	 */
+	void resume(const uint32_t fc_time_us);
+
+	/**
+	 * \brief True once enough samples have been collected for host_time() to be meaningful
+	 */
+	bool valid() const {
+		return valid_;
+	}
+
+	/**
+	 * \brief Host monotonic time (us) at which the FC clock read fc_time_us
+	 *
+	 * fc_time_us may lie before or after the latest sample. Returns 0 while the estimate is not valid.
+	 */
+	uint64_t host_time(const uint32_t fc_time_us) const;
+
+	/**
+	 * \brief Rate of the FC clock relative to the host clock, in parts per million
+	 */
+	double drift_ppm() const {
+		return (1.0 / slope_ - 1.0) * 1e6;
+	}
+
+	/**
+	 * \brief Standard deviation of the accepted samples about the model, in us
+	 */
+	double jitter_us() const {
+		return jitter_us_;
+	}
+
+	uint32_t accepted_count() const {
+		return accepted_count_;
+	}
+
+	uint32_t rejected_count() const {
+		return rejected_count_;
+	}
+
+	/**
+	 * \brief Number of times the estimator had to start over
+	 */
+	uint32_t reset_count() const {
+		return reset_count_;
+	}
+
+private:
+	struct Sample {
+		double fc;
+		double host;
+	};
+
+	void seed(const uint64_t host_time_us);
+	double predict(const double fc) const;
+	void push_bucket();
+	void fit();
+
+	// Window of bucket minima relative to the origin below
+	std::vector<Sample> samples_;
+	size_t window_;
+	size_t next_;
+	size_t count_;
+
+	// Fastest sample of the bucket currently being filled
+	bool bucket_open_;
+	double bucket_start_;
+	Sample bucket_min_;
+
+	// Unwrapping state and origin of the sample coordinates
+	bool seeded_;
+	uint32_t last_fc_time_;
+	int64_t last_fc_time_ext_;
+	int64_t fc_origin_;
+	uint64_t host_origin_;
+
+	// Model: host = intercept_ + slope_ * fc (both relative to the origins)
+	bool valid_;
+	double slope_;
+	double intercept_;
+
+	// Running mean and variance of the residuals of accepted samples
+	double residual_mean_;
+	double residual_var_;
+	double jitter_us_;
+
+	uint32_t consecutive_rejects_;
+	uint32_t accepted_count_;
+	uint32_t rejected_count_;
+	uint32_t reset_count_;
+};
+
+}
+
+#endif // BLACKBOX_CLOCK_SYNC_H
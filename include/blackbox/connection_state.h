@@ -0,0 +1,44 @@
+#ifndef BLACKBOX_CONNECTION_STATE_H
+#define BLACKBOX_CONNECTION_STATE_H
+
+#include <stdint.h>
+
+namespace blackbox {
+
+enum ConnectionState {
+	CONNECTION_CONNECTED = 0, CONNECTION_RECONNECTING, CONNECTION_CLOSED
+};
+
+/**
+ * \brief Link supervision counters, a snapshot of which comes with every connection state change
+ */
+struct ConnectionStats {
+	ConnectionStats() :
+			connects(0), disconnects(0), reconnect_attempts(0), last_outage_us(0) {
+	}
+
+	// Times the device was opened, including the first
+	uint32_t connects;
+	uint32_t disconnects;
+	// Reopen attempts that failed
+	uint32_t reconnect_attempts;
+	// How long the link was down before the most recent reconnect
+	uint64_t last_outage_us;
+};
+
+inline const char* connection_state_name(const ConnectionState state) {
+	switch (state) {
+	case CONNECTION_CONNECTED:
+		return "connected";
+	case CONNECTION_RECONNECTING:
+		return "reconnecting";
+	case CONNECTION_CLOSED:
+		return "closed";
+	}
+
+	return "unknown";
+}
+
+}
+
+#endif // BLACKBOX_CONNECTION_STATE_H
@@ -6,6 +6,8 @@
 
 #include "parser_input_stream.h"
 
+typedef void (*Tag8_4S16Decoder)(blackbox::ParserInputStream &pis, int32_t *values);
+
 void streamReadTag2_3S32(blackbox::ParserInputStream &pis, int32_t *values);
 void streamReadTag8_4S16_v1(blackbox::ParserInputStream &pis, int32_t *values);
 void streamReadTag8_4S16_v2(blackbox::ParserInputStream &pis, int32_t *values);
@@ -0,0 +1,51 @@
+#ifndef BLACKBOX_FILE_TRANSPORT_H
+#define BLACKBOX_FILE_TRANSPORT_H
+
+#include <blackbox/transport.h>
+#include <boost/asio.hpp>
+
+#include <string>
+
+namespace blackbox {
+
+/**
+ * \brief Replays a recorded blackbox log as if it were arriving over a link
+ *
+ * Unlike the live transports, reading is held off while the receive ring is full instead of dropping data, so a
+ * replay at full speed exercises the decoder without losing frames. Sent data is discarded. The transport closes
+ * itself at the end of the file.
+ */
+class FileTransport: public Transport {
+public:
+	/**
+	 * \param path Log file to replay
+	 * \param baud_rate Pace the replay like a UART at this rate (10 bits per byte), or 0 to replay as fast as possible
+	 * \throws SerialException if the file can't be opened
+	 */
+	FileTransport(const std::string &path, int baud_rate, SerialListener * const listener, size_t read_size = 0);
+
+	~FileTransport();
+
+protected:
+	bool is_open();
+	void async_read_some(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler);
+	void async_write(const WriteBuffers &buffers, const IoHandler &handler);
+	void close_device();
+
+private:
+	/**
+	 * \brief Read the next chunk from the file once the ring has room and it is due
+	 */
+	void read_chunk(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler);
+
+	int fd_;
+	int bytes_per_second_;
+
+	boost::asio::deadline_timer timer_;
+	boost::posix_time::ptime replay_start_;
+	uint64_t bytes_replayed_;
+};
+
+}
+
+#endif // BLACKBOX_FILE_TRANSPORT_H
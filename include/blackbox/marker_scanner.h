@@ -0,0 +1,39 @@
+#ifndef BLACKBOX_MARKER_SCANNER_H
+#define BLACKBOX_MARKER_SCANNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Most distinct markers a scanner can look for
+#define MARKER_SCANNER_MAX_MARKERS 8
+
+namespace blackbox {
+
+/**
+ * Finds the next byte that may start a frame, i.e. one of a small set of marker bytes. The parser uses it to skip over
+ * the garbage that follows corrupt data 16 bytes at a time instead of looking at every byte.
+ */
+class MarkerScanner {
+public:
+	MarkerScanner();
+
+	/**
+	 * Look for marker as well. Markers beyond MARKER_SCANNER_MAX_MARKERS are ignored.
+	 */
+	void addMarker(uint8_t marker);
+
+	/**
+	 * Number of bytes from the start of [data, data + length) up to the first marker, or length if there is none.
+	 */
+	size_t find(const uint8_t *data, size_t length) const;
+
+private:
+	uint8_t markers_[MARKER_SCANNER_MAX_MARKERS];
+	int markerCount_;
+
+	bool isMarker_[256];
+};
+
+}
+
+#endif
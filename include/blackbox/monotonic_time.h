@@ -0,0 +1,22 @@
+#ifndef BLACKBOX_MONOTONIC_TIME_H
+#define BLACKBOX_MONOTONIC_TIME_H
+
+#include <stdint.h>
+#include <time.h>
+
+namespace blackbox {
+
+/**
+ * \brief Current CLOCK_MONOTONIC time in microseconds
+ *
+ * Used to stamp received data; unaffected by wall clock adjustments.
+ */
+inline uint64_t monotonic_time_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+}
+
+#endif
@@ -6,6 +6,9 @@
 #include <stdio.h>
 
 #include "blackbox_fielddefs.h"
+#include "clock_sync.h"
+#include "decoders.h"
+#include "marker_scanner.h"
 #include "parser_input_stream.h"
 
 #define FLIGHT_LOG_MAX_LOGS_IN_FILE 31
@@ -26,6 +29,27 @@ public:
 		FIRMWARE_TYPE_UNKNOWN = 0, FIRMWARE_TYPE_BASEFLIGHT, FIRMWARE_TYPE_CLEANFLIGHT
 	} FirmwareType;
 
+	/**
+	 * How much of flightLogStatistics_t is kept up to date, see setStatsLevel().
+	 */
+	typedef enum StatsLevel {
+		STATS_OFF = 0, // Nothing is counted
+		STATS_COUNTERS, // Frame counts and bytes of each frame type, corrupt frames, absent iterations and resyncs
+		STATS_FULL // Also the frame size histograms and the range of every main field
+	} StatsLevel;
+
+	/**
+	 * Why a frame couldn't be decoded with the field definitions of the header. The frame is then treated as corrupt.
+	 */
+	typedef enum DecodeError {
+		DECODE_OK = 0,
+		DECODE_ERROR_UNSUPPORTED_PREDICTOR,
+		DECODE_ERROR_UNSUPPORTED_ENCODING,
+		DECODE_ERROR_NO_MOTOR_0, // A field predicted from motor[0] without that field being defined
+		DECODE_ERROR_NO_GPS_HOME, // A field predicted from the GPS home position without a GPS home frame definition
+		DECODE_ERROR_COUNT
+	} DecodeError;
+
 	typedef struct flightLogFrameStatistics_t {
 		uint32_t bytes;
 		// Frames decoded to the right length and had reasonable data in them:
@@ -37,7 +61,11 @@ public:
 		// Frames didn't decode to the right length at all
 		uint32_t corruptCount;
 
-		uint32_t sizeCount[FLIGHT_LOG_MAX_FRAME_LENGTH + 1];
+		// Frames passed on early (see setEarlyCommit()) which then turned out to be corrupt, also counted as corrupt
+		uint32_t retractedCount;
+
+		// Valid frames of each size up to FLIGHT_LOG_MAX_FRAME_LENGTH, NULL below STATS_FULL
+		uint32_t *sizeCount;
 	} flightLogFrameStatistics_t;
 
 	typedef struct flightLogFieldStatistics_t {
@@ -48,9 +76,22 @@ public:
 		// Number of frames that failed to decode:
 		uint32_t totalCorruptFrames;
 
+		// Of those, the frames the header gave no way to decode, by DecodeError
+		uint32_t decodeErrors[DECODE_ERROR_COUNT];
+
 		//If our sampling rate is less than 1, we won't log every loop iteration, and that is accounted for here:
 		uint32_t intentionallyAbsentIterations;
 
+		/*
+		 * Searches for the next frame after corrupt data or garbage: how many there were, the bytes given up on and the
+		 * time taken until a frame was found, and the I-frames turned down by their iteration and time alone on the way.
+		 */
+		uint32_t resyncCount;
+		uint64_t resyncBytesSkipped;
+		uint64_t resyncTimeUs;
+		uint32_t resyncRejectedIntraframes;
+
+		// STATS_FULL only: the range of each main field over the valid frames
 		bool haveFieldStats;
 		flightLogFieldStatistics_t field[FLIGHT_LOG_MAX_FIELDS];
 		flightLogFrameStatistics_t frame[256];
@@ -126,39 +167,176 @@ public:
 		FirmwareType firmwareType;
 	} flightLogSysConfig_t;
 
+	typedef enum FrameOpKind {
+		FRAME_OP_READ = 0, FRAME_OP_PREDICT, FRAME_OP_INCREMENT
+	} FrameOpKind;
+
+	/**
+	 * One step of decoding a frame: read readCount values with the given encoding into fields [first, first + readCount)
+	 * (FRAME_OP_READ only), then apply predictor to fields [first, first + count). FRAME_OP_INCREMENT fields are
+	 * counters which are not stored in the log at all.
+	 *
+	 * reference is the field that the MOTOR_0 and HOME_COORD predictors add, or -1 if the frame definitions lack it.
+	 */
+	typedef struct flightLogFrameOp_t {
+		uint8_t kind;
+		uint8_t first;
+		uint8_t readCount;
+		uint8_t count;
+		uint8_t fieldSigned;
+		// Kept short so an op fits in 12 bytes, see frameOpId()
+		int16_t encoding;
+		int16_t predictor;
+		int16_t reference;
+	} flightLogFrameOp_t;
+
+	/**
+	 * The parser owns all the memory this points to. The per-field arrays are sized to the fields the header declared
+	 * (fieldCapacity, at least fieldCount), rather than to FLIGHT_LOG_MAX_FIELDS.
+	 */
 	typedef struct flightLogFrameDef_t {
-		char *namesLine; // The parser owns this memory to store the field names for this frame type (as a single string)
+		char *namesLine; // The field names for this frame type (as a single string)
 
 		int fieldCount;
+		int fieldCapacity;
+
+		char **fieldName;
 
-		char *fieldName[FLIGHT_LOG_MAX_FIELDS];
+		int *fieldSigned;
+		int *predictor;
+		int *encoding;
 
-		int fieldSigned[FLIGHT_LOG_MAX_FIELDS];
-		int predictor[FLIGHT_LOG_MAX_FIELDS];
-		int encoding[FLIGHT_LOG_MAX_FIELDS];
+		// The above compiled into decoding steps once the header is complete, see compileFrameDef()
+		int opCount;
+		flightLogFrameOp_t *ops;
 	} flightLogFrameDef_t;
 
 	virtual void flightLogMetadataReady() = 0;
-	virtual void flightLogFrameReady(bool frameValid, int32_t *frame, uint8_t frameType, int fieldCount, int frameOffset, int frameSize) = 0;
+
+	/**
+	 * Called for every frame once it has been decoded and checked.
+	 *
+	 * frameStartTimeUs and frameEndTimeUs are the arrival times (CLOCK_MONOTONIC us, as marked on the input stream)
+	 * of the first and last byte of the frame, or 0 if the stream carried no arrival marks.
+	 *
+	 * frameOffset is the stream offset of the frame's marker, which keeps counting across logs and doesn't wrap however
+	 * long data is fed. Corrupt frames are reported with frameValid false and no frame. In early commit mode such a
+	 * report can follow a frame that was already passed on, with the same frameOffset, to retract it.
+	 */
+	virtual void flightLogFrameReady(bool frameValid, int32_t *frame, uint8_t frameType, int fieldCount, uint64_t frameOffset, int frameSize,
+			uint64_t frameStartTimeUs, uint64_t frameEndTimeUs) = 0;
 	virtual void flightLogEventReady(flightLogEvent_t *event) = 0;
 
 
 	Parser(ParserInputStream &pis);
+
+	/**
+	 * Parser for data pushed in with feed() as it arrives, rather than pulled from a stream by parse().
+	 */
+	Parser();
+
 	virtual ~Parser();
 
 	bool parse(bool raw);
 
+	/**
+	 * Parse the next chunk of data (push mode only), which is only referenced for the duration of the call. rxTimeUs is
+	 * its arrival time (CLOCK_MONOTONIC us), or 0 if unknown.
+	 *
+	 * Header lines and frames may be split across chunks anywhere. A frame is passed on as soon as the marker of the
+	 * next one confirms that it ended where expected, so it is held back by at most one frame, and a frame or header
+	 * line cut short by the end of the chunk is parsed again once the rest of it has arrived.
+	 */
+	void feed(const uint8_t *data, size_t length, uint64_t rxTimeUs = 0, bool raw = false);
+
+	/**
+	 * No more data is going to be fed for now, pass on the last frame without waiting for the next one to confirm it.
+	 */
+	void feedEnd(bool raw = false);
+
+	/**
+	 * Hash of the header lines of the current log read so far (64-bit FNV-1a), which identifies its field definitions
+	 * and config.
+	 */
+	uint64_t headerHash() const {
+		return headerHash_;
+	}
+
+	/**
+	 * Write the header lines of the current log to path, tagged with headerHash(), for loadHeaderSnapshot() to pick up
+	 * after a restart. The file is replaced atomically. Returns false if there is no header yet or it can't be written.
+	 */
+	bool saveHeaderSnapshot(const char *path) const;
+
+	/**
+	 * Attach to a log already in progress: take the header from a snapshot written by saveHeaderSnapshot() rather than
+	 * from the stream, and start out searching for frames. Main frames are trusted as after streamDiscontinuity(), from
+	 * the second of two I-frames that agree. A new log's header in the stream still replaces it. Must be called before
+	 * any data is parsed, returns false (and leaves the parser waiting for a header) if the snapshot is missing, damaged
+	 * or has no main frame definition.
+	 *
+	 * flightLogMetadataReady() is only called for headers read from the stream.
+	 */
+	bool loadHeaderSnapshot(const char *path, bool raw = false);
+
+	/**
+	 * Early commit mode: pass on frames laid out by the header (all but event frames) as soon as their last field has
+	 * been decoded, rather than once the next frame's marker confirms that they ended in the right place. That saves a
+	 * whole frame interval of latency. In exchange, if the byte after a frame turns out not to start another one, the
+	 * frame is retracted with a corruption report for it (see flightLogFrameReady).
+	 */
+	void setEarlyCommit(bool earlyCommit) {
+		earlyCommit_ = earlyCommit;
+	}
+
+	/**
+	 * Choose which statistics to gather (STATS_OFF by default), which starts them over. Nothing the decoding itself
+	 * needs depends on them, so with STATS_OFF they cost nothing.
+	 */
+	void setStatsLevel(StatsLevel level);
+
+	/**
+	 * The statistics of the current log gathered so far at the chosen level. Field ranges are brought up to date by
+	 * this call.
+	 */
+	const flightLogStatistics_t& stats();
+
+	/**
+	 * The input stream lost bytes, e.g. because the link dropped and came back. Header definitions and the system
+	 * config are kept, and the next frame is searched for. Main frames are only trusted again from the second of two
+	 * I-frames in a row whose iteration and time agree, the frames up to it are reported as invalid. When fed, a frame
+	 * or header line the data before the gap left unfinished or unconfirmed is dropped.
+	 */
+	void streamDiscontinuity();
+
+	/**
+	 * Mapping from FC time (the FLIGHT_LOG_FIELD_INDEX_TIME field) to host monotonic time, learnt from the arrival
+	 * times of valid main frames. It has already seen a frame by the time flightLogFrameReady is called for it, except
+	 * for frames passed on early (see setEarlyCommit()), which it only learns from once the next marker confirms them.
+	 */
+	const ClockSync& clockSync() const {
+		return clockSync_;
+	}
+
+	const mainFieldIndexes_t& mainFieldIndexes() const {
+		return mainFieldIndexes_;
+	}
+
 	int flightLogEstimateNumCells();
 
 	unsigned int flightLogVbatADCToMillivolts(uint16_t vbatADC);
 	unsigned int flightLogAmperageADCToMilliamps(uint16_t amperageADC);
 	double flightlogGyroToRadiansPerSecond(int32_t gyroRaw);
 	double flightlogAccelerationRawToGs(int32_t accRaw);
-	void flightlogFlightModeToString(uint32_t flightMode, char *dest, int destLen);
-	void flightlogFlightStateToString(uint32_t flightState, char *dest, int destLen);
+	bool flightlogFlightModeToString(uint32_t flightMode, char *dest, int destLen);
+	bool flightlogFlightStateToString(uint32_t flightState, char *dest, int destLen);
 	void flightlogFailsafePhaseToString(uint8_t failsafePhase, char *dest, int destLen);
 
 private:
+	// Push mode only: the source that hands the stream each chunk fed, and that stream
+	FeedInputSource *feedSource_;
+	ParserInputStream *feedStream_;
+
 	ParserInputStream &pis_;
 
 	typedef enum ParserState {
@@ -166,27 +344,49 @@ private:
 	} ParserState;
 
 	typedef void (*FlightLogFrameParse)(Parser &parser, bool raw);
-	typedef bool (*FlightLogFrameComplete)(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw);
+	typedef bool (*FlightLogFrameComplete)(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw);
 
 	typedef struct flightLogFrameType_t {
 		uint8_t marker;
 		FlightLogFrameParse parse;
 		FlightLogFrameComplete complete;
+		flightLogFrameDef_t *def;
 	} flightLogFrameType_t;
 
 	flightLogFrameType_t frameTypes_[6];
 
+	// The frame type each byte is the marker of, NULL for bytes which don't start a frame
+	flightLogFrameType_t *frameTypeByMarker_[256];
 
+
+	StatsLevel statsLevel_;
 	flightLogStatistics_t stats_;
 
-	//Information about fields which we need to decode them properly
-	flightLogFrameDef_t frameDefs_[256];
+	// STATS_FULL only: a size histogram for each of frameTypes_, which stats_.frame[].sizeCount point into
+	uint32_t *frameSizeCounts_;
+
+	/*
+	 * STATS_FULL only: the range of each main field kept as fields[i] ^ fieldKeyBiases_[i], where the bias is INT32_MIN
+	 * for unsigned fields and 0 for signed ones. That makes a signed comparison order both. stats() turns them into
+	 * stats_.field.
+	 */
+	int32_t fieldKeyBiases_[FLIGHT_LOG_MAX_FIELDS];
+	int32_t fieldMinKeys_[FLIGHT_LOG_MAX_FIELDS];
+	int32_t fieldMaxKeys_[FLIGHT_LOG_MAX_FIELDS];
+
+	//Information about fields which we need to decode them properly, one for each of frameTypes_
+	flightLogFrameDef_t frameDefs_[6];
 
 	flightLogSysConfig_t sysConfig_;
 
 	unsigned int frameIntervalI_;
 	unsigned int frameIntervalPNum_, frameIntervalPDenom_;
 
+	// The header lines parsed so far ("name:value\n" each) for saveHeaderSnapshot(), and their hash
+	char *headerText_;
+	size_t headerTextLength_, headerTextCapacity_;
+	uint64_t headerHash_;
+
 	mainFieldIndexes_t mainFieldIndexes_;
 	gpsGFieldIndexes_t gpsFieldIndexes_;
 	gpsHFieldIndexes_t gpsHomeFieldIndexes_;
@@ -194,6 +394,9 @@ private:
 
 	int dataVersion_;
 
+	// TAG8_4S16 changed layout in data version 2, so the decoder is picked once the header gives the version
+	Tag8_4S16Decoder readTag8_4S16_;
+
 	// Blackbox state:
 	int32_t blackboxHistoryRing_[3][FLIGHT_LOG_MAX_FIELDS];
 
@@ -203,7 +406,8 @@ private:
 	 *
 	 * Previous frame pointers are NULL when no valid history exists of that age.
 	 */
-	int32_t* mainHistory_[3];bool mainStreamIsValid_;
+	int32_t* mainHistory_[3];
+	bool mainStreamIsValid_;
 
 	int32_t gpsHomeHistory_[2][FLIGHT_LOG_MAX_FIELDS]; // 0 - space to decode new frames into, 1 - previous frame
 	bool gpsHomeIsValid_;
@@ -220,10 +424,66 @@ private:
 	uint32_t lastMainFrameIteration_;
 	uint32_t lastMainFrameTime_;
 
+	/*
+	 * Set after a gap in the stream or when attaching to a log in progress, where the above are those of a candidate
+	 * I-frame until the next I-frame agrees with it, see completeIntraframe().
+	 */
+	bool mainReferencePending_;
+
+
+	ClockSync clockSync_;
 
 	bool looksLikeFrameCompleted_;
 	bool prematureEof_;
 
+	// Set while decoding a frame the header gives no way to decode, and the errors already warned about in this log
+	DecodeError decodeError_;
+	uint32_t decodeErrorsWarned_;
+
+	bool earlyCommit_;
+
+	// Where parsing left off, so that parsing can resume once more data has been fed
+	ParserState parserState_;
+	flightLogFrameType_t *lastFrameType_;
+	uint64_t frameStart_;
+
+	// The last frame was already passed on in early commit mode, and whether it was accepted then
+	bool lastFrameCommitted_;
+	bool lastFrameAccepted_;
+
+	// The last main frame's iteration and time from before the last frame was passed on early, to return to on retraction
+	uint32_t committedMainFrameIteration_;
+	uint32_t committedMainFrameTime_;
+	bool committedMainReferencePending_;
+
+	// The clock sync sample of the last frame, if it was passed on early, held back until the frame is confirmed
+	bool clockSamplePending_;
+	uint32_t pendingClockSampleTime_;
+	uint64_t pendingClockSampleUs_;
+
+	// Set by a genuine end of log event, see parseEventFrame()
+	bool logEnded_;
+
+	// Looks for the markers of frameTypes_
+	MarkerScanner markerScanner_;
+
+	// Searching for the next frame since stream offset resyncOffset_ and CLOCK_MONOTONIC time resyncStartUs_
+	bool resyncing_;
+	uint64_t resyncOffset_;
+	uint64_t resyncStartUs_;
+
+	void init();
+	void resetLog();
+	void resetStats();
+	bool parseAvailable(bool raw, bool more);
+	void completeFrame(flightLogFrameType_t *frameType, uint64_t frameEnd, bool raw);
+	void retractFrame(flightLogFrameType_t *frameType, unsigned int frameSize);
+	void rejectUndecodableFrame(flightLogFrameType_t *frameType);
+
+	void startResync(uint64_t offset);
+	void finishResync();
+	bool plausibleIntraframe(bool raw);
+
 	void identifyFields(uint8_t frameType, flightLogFrameDef_t *frameDef);
 	void identifyMainFields(flightLogFrameDef_t *frameDef);
 	void identifyGPSFields(flightLogFrameDef_t *frameDef);
@@ -231,10 +491,50 @@ private:
 	void identifySlowFields(flightLogFrameDef_t *frameDef);
 
 	void parseHeaderLine();
-	flightLogFrameType_t* getFrameType(uint8_t c);
+	void applyHeaderLine(char *line, int lineLength);
+	void finishHeader(bool raw);
+	int startsNewLog(bool more);
+	void compileFrameDef(flightLogFrameDef_t *frameDef, bool raw);
+	void freeFrameDefs();
 
+	flightLogFrameType_t* getFrameType(uint8_t c) {
+		return frameTypeByMarker_[c];
+	}
 
+	/**
+	 * Definition of the frames with the given marker, which must be that of one of frameTypes_.
+	 */
+	flightLogFrameDef_t* frameDef(uint8_t marker) {
+		return frameTypeByMarker_[marker]->def;
+	}
 
+	/**
+	 * Look up the arrival times of the frame occupying stream offsets [frameStart, frameEnd) and pass it on to
+	 * flightLogFrameReady.
+	 */
+	void frameReady(bool frameValid, int32_t *frame, uint8_t frameType, int fieldCount, uint64_t frameStart, uint64_t frameEnd);
+
+	static void parseIntraframe(Parser &parser, bool raw);
+	static void parseInterframe(Parser &parser, bool raw);
+	static void parseGPSFrame(Parser &parser, bool raw);
+	static void parseGPSHomeFrame(Parser &parser, bool raw);
+	static void parseEventFrame(Parser &parser, bool raw);
+	static void parseSlowFrame(Parser &parser, bool raw);
+
+	static bool completeIntraframe(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw);
+	static bool completeInterframe(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw);
+	static bool completeEventFrame(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw);
+	static bool completeGPSFrame(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw);
+	static bool completeGPSHomeFrame(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw);
+	static bool completeSlowFrame(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw);
+
+	static int shouldHaveFrame(Parser &parser, int32_t frameIndex);
+	static void applyPredictions(Parser &parser, const flightLogFrameOp_t *op, int32_t *current, const int32_t *previous, const int32_t *previous2);
+	static void parseFrame(Parser &parser, uint8_t frameType, int32_t *frame, int32_t *previous, int32_t *previous2, int skippedFrames);
+	static uint32_t countIntentionallySkippedFrames(Parser &parser);
+	static uint32_t countIntentionallySkippedFramesTo(Parser &parser, uint32_t targetIteration);
+	static void updateMainFieldStatistics(Parser &parser, int32_t *fields);
+	static void flightLoginvalidateStream(Parser &parser);
 };
 
 }
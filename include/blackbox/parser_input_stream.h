@@ -2,41 +2,417 @@
 #define BLACKBOX_INPUT_STREAM_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <endian.h>
+
+/*
+ * Bytes kept from chunks already left behind, so the parser can rewind to just after the start of a corrupt frame, or
+ * to the start of a frame or header line (up to 1 KiB) that the data fed so far cut short
+ */
+#define PARSER_INPUT_HISTORY_SIZE 2048
+
+// Number of arrival time marks remembered, one per received chunk
+#define PARSER_INPUT_ARRIVAL_MARKS 64
+
+// Bytes decodeUnsignedVB() loads at once, more than the 5 of the longest value
+#define PARSER_INPUT_VB_LOAD_SIZE 8
+
+// Bits streamPeekBits() makes visible at once, as long as the window has the bytes for them
+#define PARSER_INPUT_PEEK_BITS 57
 
 namespace blackbox {
 
+class RingBuffer;
+
+/**
+ * Supplies the stream with contiguous chunks of data.
+ */
+class ParserInputSource {
+public:
+	/**
+	 * Hand out the next chunk. The previous chunk is no longer referenced by the stream once this is called.
+	 *
+	 * rxTimeUs is the arrival time (CLOCK_MONOTONIC us) of the chunk, or 0 if unknown. Returns false if there is no
+	 * more data (for now).
+	 */
+	virtual bool nextChunk(const uint8_t **data, size_t *length, uint64_t *rxTimeUs) = 0;
+
+	virtual ~ParserInputSource() {
+	}
+};
+
+/**
+ * Reads the chunks queued in a transport's receive ring, releasing each one once the stream has moved past it.
+ */
+class RingBufferInputSource: public ParserInputSource {
+public:
+	explicit RingBufferInputSource(RingBuffer &ring) :
+			ring_(ring), held_(0) {
+	}
+
+	bool nextChunk(const uint8_t **data, size_t *length, uint64_t *rxTimeUs);
+
+private:
+	RingBuffer &ring_;
+	size_t held_;
+};
+
+/**
+ * Hands the stream the chunks pushed into it, one at a time. A chunk is only referenced until the stream asks for the
+ * next one, which it does once it has read to the end of it.
+ */
+class FeedInputSource: public ParserInputSource {
+public:
+	FeedInputSource() :
+			data_(NULL), length_(0), rxTimeUs_(0) {
+	}
+
+	void push(const uint8_t *data, size_t length, uint64_t rxTimeUs) {
+		data_ = data;
+		length_ = length;
+		rxTimeUs_ = rxTimeUs;
+	}
+
+	bool nextChunk(const uint8_t **data, size_t *length, uint64_t *rxTimeUs);
+
+private:
+	const uint8_t *data_;
+	size_t length_;
+	uint64_t rxTimeUs_;
+};
+
+/**
+ * A read-only memory map of a whole log file, to parse in place.
+ */
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char *path);
+	void close();
+
+	const uint8_t* data() const {
+		return data_;
+	}
+
+	size_t size() const {
+		return size_;
+	}
+
+private:
+	const uint8_t *data_;
+	size_t size_;
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+/**
+ * A read window over the stream's data. Reads come straight out of the current contiguous chunk and only drop into
+ * refill() at the end of it, at which point the next chunk is fetched from the source. The tail of the chunks left
+ * behind is kept so the parser can still seek back into it.
+ */
 class ParserInputStream {
 public:
-	ParserInputStream(int (*getNextByte)());
+	/**
+	 * Read from chunks supplied by source.
+	 */
+	explicit ParserInputStream(ParserInputSource &source);
+
+	/**
+	 * Read from a single buffer (e.g. a MappedFile) which must outlive the stream.
+	 */
+	ParserInputStream(const uint8_t *data, size_t length);
+
 	~ParserInputStream();
 
-	int streamPeekChar();
-	int streamReadChar();
-	int streamReadByte();
-//	void streamUnreadChar(, int c);
+	int streamPeekChar() {
+		if (pos_ < end_ || refill())
+			return *pos_;
+
+		eof_ = true;
+		return EOF;
+	}
+
+	/**
+	 * Read a char from the stream, or EOF if the end of stream was reached.
+	 */
+	int streamReadChar() {
+		if (pos_ < end_ || refill())
+			return *pos_++;
+
+		eof_ = true;
+		return EOF;
+	}
+
+	/**
+	 * Read an unsigned byte from the stream, or EOF if the end of stream was reached.
+	 */
+	int streamReadByte() {
+		return streamReadChar();
+	}
+
+	void streamUnreadChar(int c) {
+		(void) c;
+
+		if (pos_ > base_)
+			pos_--;
+		else
+			streamSeek(windowOffset() - 1);
+	}
 
 	void streamRead(void *buf, int len);
 
-	uint32_t streamReadBits(int numBits);
-	int streamReadBit();
+	/**
+	 * Read `numBits` (at most 32) at the current bit index and advance the bit pointer. The first bit in the stream
+	 * becomes the highest bit set in the result, and the last bit in the stream will be the least significant bit in the
+	 * result.
+	 *
+	 * It is an error to later attempt to read a *byte* from the stream if the bit pointer is not byte-aligned (call
+	 * streamByteAlign).
+	 *
+	 * If EOF is encountered before all the requested bits were read, EOF is returned, the EOF flag is set, and the bit
+	 * pointer is properly aligned.
+	 */
+	uint32_t streamReadBits(int numBits) {
+		uint32_t result;
+
+		if (bitsLeft_ < numBits && !fillBits(numBits))
+			return EOF;
+
+		if (numBits <= 0)
+			return 0;
+
+		result = (uint32_t) (bitBuffer_ >> (64 - numBits));
+		bitBuffer_ <<= numBits;
+		bitsLeft_ -= numBits;
+
+		return result;
+	}
+
+	/**
+	 * Read the bit at the current bit index and advance the bit pointer. Returns 1 if the bit was set and 0 if the bit
+	 * was not set.
+	 *
+	 * If the file was already at EOF, EOF is returned and the EOF flag is set, and the bit pointer is byte-aligned.
+	 */
+	int streamReadBit() {
+		return streamReadBits(1);
+	}
+
+	/**
+	 * Look at the bits from the current bit index onwards without consuming them. The first one ends up in the top bit
+	 * of *bits and the return value is how many are valid, everything below those is zero. That is at least
+	 * PARSER_INPUT_PEEK_BITS unless the end of the window is close, since this never refills the window or sets EOF.
+	 * Decoders use it to find a whole code at once and take it with streamSkipBits().
+	 */
+	int streamPeekBits(uint64_t *bits) {
+		if (bitsLeft_ < PARSER_INPUT_PEEK_BITS && end_ - pos_ >= 8)
+			fillBits(PARSER_INPUT_PEEK_BITS);
+
+		*bits = bitBuffer_;
+		return bitsLeft_;
+	}
+
+	/**
+	 * Consume numBits (less than 64) of those returned by the last streamPeekBits().
+	 */
+	void streamSkipBits(int numBits) {
+		bitBuffer_ <<= numBits;
+		bitsLeft_ -= numBits;
+	}
+
 	void streamByteAlign();
 
-	uint32_t streamReadUnsignedVB();
-	int32_t streamReadSignedVB();
+	/**
+	 * Read a variable byte unsigned integer. Inline along with streamReadSignedVB(), since the call would cost about
+	 * as much as decoding the typical one byte value.
+	 */
+	uint32_t streamReadUnsignedVB() {
+		uint32_t result;
+
+		// Away from the end of the window decode straight from it
+		if (end_ - pos_ >= PARSER_INPUT_VB_LOAD_SIZE) {
+			pos_ = decodeUnsignedVB(pos_, &result);
+			return result;
+		}
+
+		return readUnsignedVBBytewise();
+	}
+
+	int32_t streamReadSignedVB() {
+		const uint32_t value = streamReadUnsignedVB();
+
+		// ZigZag decoding as by zigzagDecode(), without the call
+		return (value >> 1) ^ -(int32_t) (value & 1);
+	}
+
+	/**
+	 * Decode the variable byte unsigned integer at p, which must be followed by at least PARSER_INPUT_VB_LOAD_SIZE
+	 * readable bytes, with one load and no branch per byte. Returns the address just past it. Like
+	 * streamReadUnsignedVB(), an encoding longer than 5 bytes decodes to 0 and only its first 5 bytes are consumed.
+	 */
+	static const uint8_t* decodeUnsignedVB(const uint8_t *p, uint32_t *value) {
+		uint64_t word, stops;
+
+		/*
+		 * Most logged values are small deltas that fit in one byte, which a compare takes care of. The load is only worth
+		 * it for the longer ones, through it the next value's address waits on the whole decode.
+		 */
+		if (*p < 0x80) {
+			*value = *p;
+			return p + 1;
+		}
+
+		memcpy(&word, p, sizeof(word));
+		word = le64toh(word);
+
+		// A clear top bit marks the final byte, and only the first 5 may be final
+		stops = ~word & 0x0000008080808080ULL;
+
+		if (!stops) {
+			*value = 0;
+			return p + 5;
+		}
+
+		// Bit index of the final byte's top bit, keep the 7 payload bits of every byte up to it
+		const int last = __builtin_ctzll(stops);
+
+		word &= 0x0000007F7F7F7F7FULL & (~(uint64_t) 0 >> (63 - last));
+
+		// Squeeze out the gaps: 7 bit groups into 14, then 28, then 56
+		word = (word & 0x007F007F007F007FULL) | ((word & 0x7F007F007F007F00ULL) >> 1);
+		word = (word & 0x00003FFF00003FFFULL) | ((word & 0x3FFF00003FFF0000ULL) >> 2);
+		word = (word & 0x000000000FFFFFFFULL) | ((word & 0x0FFFFFFF00000000ULL) >> 4);
+
+		*value = (uint32_t) word;
+		return p + (last >> 3) + 1;
+	}
+
+	/**
+	 * Bytes that can be read through streamPointer() before the window has to be refilled. Decoders use this to decode
+	 * straight from memory when the whole encoded value is known to be there.
+	 */
+	size_t streamAvailable() const {
+		return end_ - pos_;
+	}
+
+	const uint8_t* streamPointer() const {
+		return pos_;
+	}
+
+	/**
+	 * Consume length bytes read through streamPointer(), at most streamAvailable().
+	 */
+	void streamSkip(size_t length) {
+		pos_ += length;
+	}
+
+	/**
+	 * Move on to the next chunk of the source once the current window is used up. Returns false at the end of the data.
+	 */
+	bool refill();
+
+	/**
+	 * Number of bytes read from the start of the stream, i.e. the offset of the next byte to be read. Whole bytes still
+	 * waiting in the bit reservoir have not been read yet.
+	 */
+	uint64_t streamOffset() const {
+		return windowOffset() - (bitsLeft_ >> 3);
+	}
+
+	/**
+	 * Move the read position to an earlier (or later, already fetched) offset. Only the current chunk and the last
+	 * PARSER_INPUT_HISTORY_SIZE bytes before it can be returned to. Clears the EOF flag.
+	 */
+	bool streamSeek(uint64_t offset);
+
+	/**
+	 * Treat the current position as the end of the stream, every further read returns EOF.
+	 */
+	void streamEnd();
+
+	bool streamEof() const {
+		return eof_;
+	}
+
+	void streamClearEof() {
+		eof_ = false;
+	}
+
+	/**
+	 * Record that the bytes fetched from now on arrived at rxTimeUs (CLOCK_MONOTONIC us). Done automatically for
+	 * every chunk from the source that carries a time.
+	 */
+	void streamMarkArrival(uint64_t rxTimeUs);
+
+	/**
+	 * Arrival time of the byte at the given stream offset, or 0 if unknown.
+	 */
+	uint64_t streamArrivalTime(uint64_t offset) const;
 
 private:
-	int (*getNextByte_)();
-	const char data_;
+	ParserInputSource *source_;
+
+	// The read window: [base_, end_) with the read position at pos_, base_ lies at stream offset baseOffset_
+	const uint8_t *base_;
+	const uint8_t *pos_;
+	const uint8_t *end_;
+	uint64_t baseOffset_;
 
-	//When reading bit-by-bit, the index of the next bit to be read within the byte at pos (from the high bit of index 7..0)
-	int bitPos_;
+	// The newest chunk from the source and its stream offset, the window is either this or the history
+	const uint8_t *chunk_;
+	size_t chunkLength_;
+	uint64_t chunkOffset_;
+
+	// The last historyLength_ bytes before chunkOffset_
+	uint8_t history_[PARSER_INPUT_HISTORY_SIZE];
+	size_t historyLength_;
+
+	// Offset at which the stream was ended by streamEnd(), if ended_
+	uint64_t endOffset_;
+	bool ended_;
+
+	/*
+	 * Bit reservoir: the next bitsLeft_ unread bits of the stream, first bit in the top bit of bitBuffer_ and everything
+	 * below them zero. Whole bytes in it were taken out of the window ahead of time and are handed back on alignment.
+	 */
+	uint64_t bitBuffer_;
+	int bitsLeft_;
 
 	//Set to true if we attempt to read from the log when it is already exhausted
 	bool eof_;
+
+	struct ArrivalMark {
+		uint64_t offset;
+		uint64_t rxTimeUs;
+	};
+
+	ArrivalMark arrivalMarks_[PARSER_INPUT_ARRIVAL_MARKS];
+	unsigned int arrivalMarkCount_;
+
+	uint64_t windowOffset() const {
+		return baseOffset_ + (pos_ - base_);
+	}
+
+	/**
+	 * Top the bit reservoir up to at least numBits, false (with the reservoir emptied and EOF set) if the stream ends first.
+	 */
+	bool fillBits(int numBits);
+
+	/**
+	 * streamReadUnsignedVB() a byte at a time, for values that may straddle a refill or run into the end of the data.
+	 */
+	uint32_t readUnsignedVBBytewise();
+
+	void setWindow(const uint8_t *base, size_t length, uint64_t baseOffset, uint64_t offset);
+	void retireChunk();
 };
 
 }
 
-
 #endif
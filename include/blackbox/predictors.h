@@ -0,0 +1,46 @@
+#ifndef BLACKBOX_PREDICTORS_H
+#define BLACKBOX_PREDICTORS_H
+
+#include <stdint.h>
+
+#include "blackbox_fielddefs.h"
+
+namespace blackbox {
+
+/**
+ * Apply a prediction from the previous frames in place to a run of count fields. fields, previous and previous2 all
+ * point at the first field of the run, and previous2 is only read by STRAIGHT_LINE and AVERAGE_2.
+ *
+ * With the predictor and the signedness (which only matters to AVERAGE_2) fixed at compile time, nothing is left to
+ * branch on inside the loop and the compiler is free to vectorize it. All arithmetic wraps like the firmware's.
+ */
+template<int Predictor, bool FieldSigned>
+inline void predictFromHistory(int32_t *fields, const int32_t *previous, const int32_t *previous2, int count) {
+	for (int i = 0; i < count; i++) {
+		const uint32_t last = (uint32_t) previous[i];
+		uint32_t prediction;
+
+		if (Predictor == FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS)
+			prediction = last;
+		else if (Predictor == FLIGHT_LOG_FIELD_PREDICTOR_STRAIGHT_LINE)
+			prediction = 2 * last - (uint32_t) previous2[i];
+		else if (FieldSigned)
+			prediction = (uint32_t) ((int32_t) (last + (uint32_t) previous2[i]) / 2);
+		else
+			prediction = (last + (uint32_t) previous2[i]) / 2;
+
+		fields[i] = (int32_t) ((uint32_t) fields[i] + prediction);
+	}
+}
+
+/**
+ * Apply a prediction that is the same for every field of the run (minthrottle, motor[0], the GPS home position...).
+ */
+inline void predictFromOffset(int32_t *fields, uint32_t offset, int count) {
+	for (int i = 0; i < count; i++)
+		fields[i] = (int32_t) ((uint32_t) fields[i] + offset);
+}
+
+}
+
+#endif // BLACKBOX_PREDICTORS_H
@@ -0,0 +1,46 @@
+#ifndef BLACKBOX_PTY_TRANSPORT_H
+#define BLACKBOX_PTY_TRANSPORT_H
+
+#include <blackbox/transport.h>
+#include <boost/asio.hpp>
+
+#include <string>
+
+namespace blackbox {
+
+/**
+ * \brief Transport over the master side of a pseudo-terminal
+ *
+ * Whatever is written to slave_name() (a simulator, socat, or cat of a recorded log) is received as if it came from
+ * the flight controller's UART, and data we send can be read back from the slave.
+ */
+class PtyTransport: public Transport {
+public:
+	explicit PtyTransport(SerialListener * const listener, size_t read_size = 0);
+
+	~PtyTransport();
+
+	/**
+	 * \brief Device path of the slave side, e.g. /dev/pts/3
+	 */
+	const std::string& slave_name() const {
+		return slave_name_;
+	}
+
+protected:
+	bool is_open();
+	void async_read_some(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler);
+	void async_write(const WriteBuffers &buffers, const IoHandler &handler);
+	void close_device();
+
+private:
+	boost::asio::posix::stream_descriptor master_;
+	std::string slave_name_;
+
+	// Held open so reads on the master don't fail with EIO while no one else has the slave open
+	int slave_fd_;
+};
+
+}
+
+#endif // BLACKBOX_PTY_TRANSPORT_H
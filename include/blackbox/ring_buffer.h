@@ -0,0 +1,111 @@
+#ifndef BLACKBOX_RING_BUFFER_H
+#define BLACKBOX_RING_BUFFER_H
+
+#include <boost/atomic.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace blackbox {
+
+/**
+ * \brief Bounded single-producer/single-consumer byte ring
+ *
+ * The producer (I/O thread) appends whole read chunks together with their receive time, the consumer (decode thread)
+ * takes them back out as contiguous spans. Neither side ever blocks or takes a lock. A chunk that does not fit is
+ * dropped as a whole and counted as an overflow.
+ */
+class RingBuffer {
+public:
+	/**
+	 * \param capacity Size of the byte storage, rounded up to a power of two
+	 */
+	explicit RingBuffer(size_t capacity);
+
+	~RingBuffer();
+
+	/**
+	 * \brief Producer side: append a chunk
+	 * \return false if there was no room and the chunk was dropped
+	 */
+	bool write(const uint8_t * const data, const size_t length, const uint64_t rx_time_us);
+
+	/**
+	 * \brief Consumer side: get the next contiguous span of the oldest chunk without removing it
+	 * \return false if the ring is empty
+	 */
+	bool peek(const uint8_t **data, size_t *length, uint64_t *rx_time_us);
+
+	/**
+	 * \brief Consumer side: release length bytes of the span returned by peek()
+	 */
+	void consume(const size_t length);
+
+	bool empty() const {
+		return head_.load(boost::memory_order_acquire) == tail_.load(boost::memory_order_acquire);
+	}
+
+	size_t size() const {
+		return head_.load(boost::memory_order_acquire) - tail_.load(boost::memory_order_acquire);
+	}
+
+	/**
+	 * \brief Total bytes ever written, the position a chunk written now would start at
+	 */
+	size_t write_position() const {
+		return head_.load(boost::memory_order_acquire);
+	}
+
+	/**
+	 * \brief Total bytes ever consumed
+	 */
+	size_t read_position() const {
+		return tail_.load(boost::memory_order_acquire);
+	}
+
+	size_t capacity() const {
+		return capacity_;
+	}
+
+	/**
+	 * \brief Largest number of bytes that have been waiting in the ring at once
+	 */
+	size_t high_water_mark() const {
+		return high_water_mark_.load(boost::memory_order_relaxed);
+	}
+
+	/**
+	 * \brief Number of chunks dropped because the ring was full
+	 */
+	uint32_t overflow_count() const {
+		return overflow_count_.load(boost::memory_order_relaxed);
+	}
+
+private:
+	struct Chunk {
+		size_t length;
+		uint64_t rx_time_us;
+	};
+
+	uint8_t *data_;
+	size_t capacity_;
+	size_t mask_;
+
+	// Free running byte counters, only the producer writes head_ and only the consumer writes tail_
+	boost::atomic<size_t> head_;
+	boost::atomic<size_t> tail_;
+
+	boost::lockfree::spsc_queue<Chunk> chunks_;
+
+	// Consumer-side state of the chunk currently being drained
+	size_t chunk_remaining_;
+	uint64_t chunk_rx_time_us_;
+
+	boost::atomic<size_t> high_water_mark_;
+	boost::atomic<uint32_t> overflow_count_;
+};
+
+}
+
+#endif // BLACKBOX_RING_BUFFER_H
@@ -4,11 +4,36 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <blackbox/connection_state.h>
+#include <blackbox/monotonic_time.h>
+
 namespace blackbox {
 
 class SerialListener {
 public:
-	virtual void serial_data_received(const uint8_t byte) = 0;
+	/**
+	 * \brief Called once for every chunk of data read from the port
+	 * \param data Received bytes, only valid for the duration of the call
+	 * \param length Number of bytes at data
+	 * \param rx_time_us CLOCK_MONOTONIC time (us) at which the read completed
+	 */
+	virtual void serial_data_received(const uint8_t * const data, const size_t length, const uint64_t rx_time_us) = 0;
+
+	/**
+	 * \brief Per-byte compatibility shim, forwards a one byte chunk stamped with the current time
+	 */
+	virtual void serial_data_received(const uint8_t byte) {
+		serial_data_received(&byte, 1, monotonic_time_us());
+	}
+
+	/**
+	 * \brief Called on the decode thread when the link goes down or comes back
+	 *
+	 * Delivered in order with the data, so every chunk received before the change has already been passed on.
+	 */
+	virtual void serial_connection_changed(const ConnectionState state, const ConnectionStats &stats) {
+	}
+
 	virtual ~SerialListener() {};
 };
 
@@ -0,0 +1,46 @@
+/**
+ * \file serial_termios.h
+ *
+ * Linux specific tty configuration that boost::asio::serial_port can't express: arbitrary baud rates through
+ * termios2/BOTHER, ASYNC_LOW_LATENCY and explicit VMIN/VTIME. Kept apart from serial.h because <asm/termbits.h>
+ * clashes with the <termios.h> pulled in by boost::asio.
+ */
+
+#ifndef BLACKBOX_SERIAL_TERMIOS_H
+#define BLACKBOX_SERIAL_TERMIOS_H
+
+namespace blackbox {
+
+struct SerialOptions {
+	SerialOptions() :
+			baud_rate(115200), low_latency(false), rtscts(false), vmin(1), vtime(0) {
+	}
+
+	int baud_rate;
+
+	// Configure the tty through termios2 and request ASYNC_LOW_LATENCY from the driver
+	bool low_latency;
+
+	// RTS/CTS hardware flow control
+	bool rtscts;
+
+	// Raw mode read() timing, only used in low latency mode: minimum bytes and inter-byte timeout in tenths of a second
+	int vmin;
+	int vtime;
+};
+
+/**
+ * \brief Put the tty into raw 8N1 mode at options.baud_rate, which need not be a standard rate
+ * \throws SerialException if the termios2 ioctls fail
+ */
+void termios_configure(int fd, const SerialOptions &options);
+
+/**
+ * \brief Set or clear ASYNC_LOW_LATENCY on the tty
+ * \return false if the driver doesn't support the serial_struct ioctls (e.g. most USB CDC ACM devices)
+ */
+bool termios_set_low_latency(int fd, bool low_latency);
+
+}
+
+#endif // BLACKBOX_SERIAL_TERMIOS_H
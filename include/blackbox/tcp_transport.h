@@ -0,0 +1,44 @@
+#ifndef BLACKBOX_TCP_TRANSPORT_H
+#define BLACKBOX_TCP_TRANSPORT_H
+
+#include <blackbox/transport.h>
+#include <boost/asio.hpp>
+
+#include <string>
+
+namespace blackbox {
+
+/**
+ * \brief Transport over a TCP client connection, e.g. to a serial-to-network bridge
+ */
+class TcpTransport: public Transport {
+public:
+	/**
+	 * \throws SerialException if the host can't be resolved or the connection is refused
+	 */
+	TcpTransport(const std::string &host, int port, SerialListener * const listener, size_t read_size = 0);
+
+	~TcpTransport();
+
+protected:
+	bool is_open();
+	void async_read_some(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler);
+	void async_write(const WriteBuffers &buffers, const IoHandler &handler);
+	void close_device();
+	bool reconnectable();
+	void reopen_device();
+
+private:
+	/**
+	 * \throws SerialException if the host can't be resolved or the connection is refused
+	 */
+	void connect();
+
+	std::string host_;
+	int port_;
+	boost::asio::ip::tcp::socket socket_;
+};
+
+}
+
+#endif // BLACKBOX_TCP_TRANSPORT_H
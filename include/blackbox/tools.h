@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #define ARRAY_LENGTH(x) (sizeof((x))/sizeof((x)[0]))
 
@@ -10,6 +11,10 @@
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef union floatConvert_t {
 	float f;
 	uint32_t u;
@@ -39,4 +44,8 @@ bool endsWith(const char *string, const char *checkEndsWith);
 
 void* memmem(const void *haystack, size_t haystackLen, const void *needle, size_t needleLen);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
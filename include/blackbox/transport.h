@@ -0,0 +1,329 @@
+/**
+ * \file transport.h
+ *
+ * Byte transport the blackbox stream arrives over. The base class owns the I/O thread, the receive ring and decode
+ * thread, the preallocated write path and link supervision; subclasses only open their device and start reads and
+ * writes on it.
+ */
+
+#ifndef BLACKBOX_TRANSPORT_H
+#define BLACKBOX_TRANSPORT_H
+
+#include <blackbox/connection_state.h>
+#include <blackbox/ring_buffer.h>
+#include <blackbox/serial_listener.h>
+#include <blackbox/serial_exception.h>
+#include <blackbox/serial_termios.h>
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+// Reads alternate between SERIAL_READ_BUFFERS buffers, so the next read is in flight while a chunk is handed off
+#define SERIAL_READ_BUFFERS 2
+// Adaptive read size: starts at SERIAL_READ_BUF_SIZE and follows the bytes per read between the min and max
+#define SERIAL_READ_BUF_SIZE 256
+#define SERIAL_READ_MIN_SIZE 64
+#define SERIAL_READ_MAX_SIZE 4096
+#define SERIAL_WRITE_BUF_SIZE 256
+#define SERIAL_WRITE_SLOTS 64 // must be a power of two
+#define SERIAL_RX_RING_SIZE 65536
+// Reconnect backoff doubles from the first to the last delay
+#define SERIAL_RECONNECT_MIN_MS 10
+#define SERIAL_RECONNECT_MAX_MS 5000
+// Bucket i of the bytes per read histogram counts reads of [2^i, 2^(i+1)) bytes, the last one everything bigger
+#define TRANSPORT_READ_HISTOGRAM_BUCKETS 13
+
+namespace blackbox {
+
+/**
+ * \brief Selects and configures the transport built by create_transport()
+ */
+struct TransportOptions {
+	TransportOptions() :
+			type("serial"), port("/dev/ttyUSB0"), remote_port(0), local_port(0), replay_realtime(false), read_size(0) {
+	}
+
+	// One of "serial", "pty", "udp", "tcp" or "file"
+	std::string type;
+
+	// tty device for "serial"
+	std::string port;
+	SerialOptions serial;
+
+	// Server for "tcp", peer to send to for "udp" (if empty, replies go to whoever sent last)
+	std::string host;
+	int remote_port;
+
+	// Port to listen on for "udp"
+	int local_port;
+
+	// Log to replay for "file", either as fast as it can be decoded or paced at serial.baud_rate
+	std::string file;
+	bool replay_realtime;
+
+	// Bytes requested per read, 0 to adapt to the traffic (ignored by "udp", which always reads whole datagrams)
+	size_t read_size;
+};
+
+/**
+ * \brief Snapshot of the transport counters, all free running since the transport was created
+ */
+struct TransportStats {
+	uint64_t rx_bytes;
+	uint64_t tx_bytes;
+	uint64_t read_count;
+	uint64_t write_count;
+	uint64_t read_histogram[TRANSPORT_READ_HISTOGRAM_BUCKETS];
+
+	// Write slots queued right now, and the most there have ever been
+	size_t write_queue_depth;
+	size_t write_queue_max_depth;
+
+	// Time from send_data() to the completion of the write carrying it, per write slot
+	uint64_t write_latency_count;
+	uint64_t write_latency_sum_us;
+	uint64_t write_latency_max_us;
+
+	size_t rx_high_water_mark;
+	uint32_t rx_overflow_count;
+};
+
+class Transport {
+public:
+	virtual ~Transport();
+
+	/**
+	 * \brief Queue data for transmission without allocating
+	 *
+	 * Data longer than SERIAL_WRITE_BUF_SIZE is spread over consecutive write slots.
+	 * \return false if there were not enough free write slots, in which case nothing is queued
+	 */
+	bool send_data(const uint8_t* const data, const size_t length);
+
+	/**
+	 * \brief Largest number of received bytes that have waited for the decode thread at once
+	 */
+	size_t rx_high_water_mark() const {
+		return rx_ring_.high_water_mark();
+	}
+
+	/**
+	 * \brief Number of read chunks dropped because the decode thread fell too far behind
+	 */
+	uint32_t rx_overflow_count() const {
+		return rx_ring_.overflow_count();
+	}
+
+	/**
+	 * \brief Read every counter, safe to call from any thread
+	 */
+	TransportStats stats();
+
+	ConnectionState connection_state();
+
+	ConnectionStats connection_stats();
+
+protected:
+	typedef boost::function<void(const boost::system::error_code&, size_t)> IoHandler;
+	typedef boost::array<boost::asio::const_buffer, SERIAL_WRITE_SLOTS> WriteBuffers;
+
+	/**
+	 * \param listener Receives every chunk read from the device, on the decode thread
+	 * \param read_size Bytes requested per read, or 0 to adapt between SERIAL_READ_MIN_SIZE and SERIAL_READ_MAX_SIZE
+	 */
+	Transport(SerialListener * const listener, size_t read_size = 0);
+
+	/**
+	 * \brief Start the decode and I/O threads, called by subclasses once their device is open
+	 */
+	void start();
+
+	/**
+	 * \brief Stops communication and closes the device, subclasses must call this from their destructor
+	 */
+	void close();
+
+	/**
+	 * \brief Free space in the receive ring, for transports that can hold off reading instead of overflowing
+	 */
+	size_t rx_ring_free() const {
+		return rx_ring_.capacity() - rx_ring_.size();
+	}
+
+	virtual bool is_open() = 0;
+
+	/**
+	 * \brief Start reading at most buffer_size(buffer) bytes, calling handler on the I/O thread when done
+	 */
+	virtual void async_read_some(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) = 0;
+
+	/**
+	 * \brief Start writing all of buffers, calling handler on the I/O thread once everything is sent
+	 */
+	virtual void async_write(const WriteBuffers &buffers, const IoHandler &handler) = 0;
+
+	virtual void close_device() = 0;
+
+	/**
+	 * \brief True if the device can be reopened after an I/O error, otherwise the first error closes the transport
+	 */
+	virtual bool reconnectable() {
+		return false;
+	}
+
+	/**
+	 * \brief Open the device again after close_device(), called on the I/O thread without mutex_ held
+	 * \throws SerialException if the device isn't back yet
+	 */
+	virtual void reopen_device() {
+	}
+
+	boost::asio::io_service io_service_;
+
+private:
+	struct WriteSlot {
+		uint8_t data[SERIAL_WRITE_BUF_SIZE];
+		size_t len;
+		uint64_t queued_us;
+	};
+
+	typedef boost::lock_guard<boost::mutex> mutex_lock;
+
+	struct ConnectionEvent {
+		// rx_ring_ write position at the time of the change
+		size_t position;
+		ConnectionState state;
+		ConnectionStats stats;
+	};
+
+	void do_async_read();
+
+	/**
+	 * \brief Follow the bytes per read: grow at once when a read fills its buffer, shrink slowly towards twice the average
+	 */
+	void adapt_read_size(const size_t bytes_transferred);
+
+	/**
+	 * \brief Handler for end of asynchronous read operation, re-arms the read and queues the chunk for the decode thread
+	 * \param error Error code
+	 * \param bytes_transferred Number of bytes read into read_bufs_[read_index_]
+	 */
+	void async_read_end(const boost::system::error_code& error, size_t bytes_transferred);
+
+	/**
+	 * \brief Body of the decode thread, drains rx_ring_ into the listener
+	 */
+	void decode_loop();
+
+	/**
+	 * \brief Start one gathered asynchronous write of every queued write slot, caller must hold mutex_
+	 */
+	void do_async_write();
+
+	/**
+	 * \brief Handler for end of asynchronous write operation, releases the written slots and sends anything queued since
+	 * \param error Error code
+	 * \param bytes_transferred Number of bytes sent
+	 */
+	void async_write_end(const boost::system::error_code& error, size_t bytes_transferred);
+
+	/**
+	 * \brief Handle a failed read or write: close the device and either schedule a reconnect or shut down
+	 */
+	void io_error(const boost::system::error_code& error);
+
+	/**
+	 * \brief Record a connection state change and queue it for the decode thread, caller must hold mutex_
+	 */
+	void set_connection_state(const ConnectionState state);
+
+	/**
+	 * \brief Pass queued connection events to the listener once the data before them has been delivered
+	 */
+	void deliver_connection_events();
+
+	void schedule_reconnect();
+
+	/**
+	 * \brief Reconnect timer handler, reopens the device or backs off further
+	 *
+	 * mutex_ is released while the device is reopened, and only taken again to publish the outcome.
+	 */
+	void reconnect(const boost::system::error_code& error);
+
+	SerialListener* listener_;
+
+	boost::thread io_thread_;
+	boost::mutex mutex_;
+
+	std::vector<uint8_t> read_bufs_[SERIAL_READ_BUFFERS];
+	size_t read_index_;
+	size_t read_size_;
+	size_t read_min_size_;
+	size_t read_max_size_;
+	// Running average of bytes per read, in 1/16 byte
+	size_t read_average_;
+
+	RingBuffer rx_ring_;
+	boost::thread decode_thread_;
+	boost::mutex decode_mutex_;
+	boost::condition_variable decode_cond_;
+	bool decoding_;
+
+	// Ring of preallocated write slots, write_head_ and write_tail_ are free running counters guarded by mutex_
+	WriteSlot write_slots_[SERIAL_WRITE_SLOTS];
+	size_t write_head_;
+	size_t write_tail_;
+	size_t write_inflight_;
+	WriteBuffers write_buffers_;
+	bool write_in_progress_;
+
+	// Link supervision, guarded by mutex_
+	ConnectionState connection_state_;
+	ConnectionStats connection_stats_;
+	boost::asio::deadline_timer reconnect_timer_;
+	unsigned int reconnect_backoff_ms_;
+	uint64_t disconnect_time_us_;
+	// reconnect() is opening the device without holding mutex_
+	bool reopening_;
+
+	// Counters, only ever incremented by one thread at a time but read from anywhere
+	boost::atomic<uint64_t> rx_bytes_;
+	boost::atomic<uint64_t> tx_bytes_;
+	boost::atomic<uint64_t> read_count_;
+	boost::atomic<uint64_t> write_count_;
+	boost::atomic<uint64_t> read_histogram_[TRANSPORT_READ_HISTOGRAM_BUCKETS];
+	boost::atomic<size_t> write_queue_depth_;
+	boost::atomic<size_t> write_queue_max_depth_;
+	boost::atomic<uint64_t> write_latency_count_;
+	boost::atomic<uint64_t> write_latency_sum_us_;
+	boost::atomic<uint64_t> write_latency_max_us_;
+
+	// Produced by whoever holds mutex_, consumed by the decode thread
+	boost::lockfree::spsc_queue<ConnectionEvent, boost::lockfree::capacity<16> > connection_events_;
+
+	/*
+	 * Guarded by decode_mutex_: the latest change since connection_events_ was last found full. Changes coalesce here
+	 * rather than being dropped until the decode thread has caught up with the queue, so the last state always arrives.
+	 */
+	bool connection_event_pending_;
+	ConnectionEvent pending_connection_event_;
+};
+
+/**
+ * \brief Build the transport selected by options.type
+ * \throws SerialException if the type is unknown or the device can't be opened
+ */
+Transport* create_transport(const TransportOptions &options, SerialListener * const listener);
+
+}
+
+#endif // BLACKBOX_TRANSPORT_H
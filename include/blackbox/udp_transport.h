@@ -0,0 +1,56 @@
+#ifndef BLACKBOX_UDP_TRANSPORT_H
+#define BLACKBOX_UDP_TRANSPORT_H
+
+#include <blackbox/transport.h>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+
+// Comfortably above the MTU of any bridge we'd receive from
+#define UDP_READ_BUF_SIZE 2048
+
+namespace blackbox {
+
+/**
+ * \brief Transport over UDP datagrams, each datagram is received as one chunk
+ *
+ * Data is sent to the configured peer, or if none was given, to whoever sent the most recent datagram.
+ */
+class UdpTransport: public Transport {
+public:
+	/**
+	 * \param remote_host Peer to send to, may be empty
+	 * \param remote_port Port of the peer
+	 * \param local_port Port to receive on
+	 * \throws SerialException if the socket can't be bound or the peer can't be resolved
+	 */
+	UdpTransport(const std::string &remote_host, int remote_port, int local_port, SerialListener * const listener);
+
+	~UdpTransport();
+
+protected:
+	bool is_open();
+	void async_read_some(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler);
+	void async_write(const WriteBuffers &buffers, const IoHandler &handler);
+	void close_device();
+
+private:
+	/**
+	 * \brief Remember the sender as the peer if none was configured, then pass the result on
+	 */
+	void receive_end(const IoHandler &handler, const boost::system::error_code& error, size_t bytes_transferred);
+
+	boost::asio::ip::udp::socket socket_;
+
+	boost::asio::ip::udp::endpoint sender_endpoint_;
+
+	boost::mutex peer_mutex_;
+	boost::asio::ip::udp::endpoint peer_endpoint_;
+	bool have_peer_;
+	bool fixed_peer_;
+};
+
+}
+
+#endif // BLACKBOX_UDP_TRANSPORT_H
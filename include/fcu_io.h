@@ -20,6 +20,8 @@
 #include <sensor_msgs/Temperature.h>
 #include <sensor_msgs/Range.h>
 #include <std_srvs/Trigger.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
 
 #include <fcu_common/Attitude.h>
 #include <fcu_common/ExtendedCommand.h>
@@ -31,15 +33,29 @@
 
 #include <blackbox/blackbox.h>
 #include <blackbox/blackbox_listener.h>
+#include <blackbox/clock_sync.h>
+#include <blackbox/parser.h>
 
 namespace fcu_io {
 
-class fcuIO: public blackbox::BlackboxListener {
+/**
+ * \brief Decodes the blackbox log streamed by the flight controller as it arrives and publishes its contents
+ */
+class fcuIO: public blackbox::BlackboxListener, public blackbox::Parser {
 public:
 	fcuIO();
 	virtual ~fcuIO();
 
-	virtual void handle_blackbox_message(const uint8_t byte);
+	using blackbox::BlackboxListener::handle_blackbox_message;
+
+	virtual void handle_blackbox_message(const uint8_t * const data, const size_t length, const uint64_t rx_time_us);
+	virtual void handle_connection_changed(const blackbox::ConnectionState state, const blackbox::ConnectionStats &stats);
+
+	// Parser callbacks, on the transport's decode thread like the data
+	virtual void flightLogMetadataReady();
+	virtual void flightLogFrameReady(bool frameValid, int32_t *frame, uint8_t frameType, int fieldCount, uint64_t frameOffset, int frameSize,
+			uint64_t frameStartTimeUs, uint64_t frameEndTimeUs);
+	virtual void flightLogEventReady(flightLogEvent_t *event);
 
 //  virtual void on_new_param_received(std::string name, double value);
 //  virtual void on_param_value_updated(std::string name, double value);
@@ -49,6 +65,9 @@ private:
 	// ROS message callbacks
 	void commandCallback(fcu_common::ExtendedCommand::ConstPtr msg);
 
+	// ROS timer callbacks
+	void diagnosticsTimerCallback(const ros::TimerEvent &event);
+
 	// ROS service callbacks
 	bool paramGetSrvCallback(fcu_io::ParamGet::Request &req, fcu_io::ParamGet::Response &res);
 	bool paramSetSrvCallback(fcu_io::ParamSet::Request &req, fcu_io::ParamSet::Response &res);
@@ -64,11 +83,20 @@ private:
 		return value < min ? min : (value > max ? max : value);
 	}
 
+	/**
+	 * \brief Header stamp for an FC timestamp, through the parser's clock sync estimate
+	 *
+	 * Falls back to the receive time (or now) while the estimate is still warming up.
+	 */
+	ros::Time fcTimeToRos(const blackbox::ClockSync &clock_sync, uint32_t fc_time_us, uint64_t rx_time_us);
+
 	ros::NodeHandle nh_;
 
 	ros::Subscriber command_sub_;
 
 	ros::Publisher unsaved_params_pub_;
+	ros::Publisher connection_state_pub_;
+	ros::Publisher diagnostics_pub_;
 	ros::Publisher imu_pub_;
 	ros::Publisher imu_temp_pub_;
 	ros::Publisher servo_output_raw_pub_;
@@ -93,6 +121,17 @@ private:
 	ros::ServiceServer calibrate_rc_srv_;
 
 	blackbox::Blackbox *blackbox_;
+	std::string blackbox_transport_name_;
+
+	// Where the log header is kept for attaching to a log in progress after a restart (empty for nowhere), and the hash
+	// of the header last saved there or loaded from it
+	std::string header_cache_;
+	uint64_t header_cache_hash_;
+
+	ros::Timer diagnostics_timer_;
+	// Counters as of the previous diagnostics message, to turn them into rates
+	blackbox::TransportStats last_transport_stats_;
+	ros::WallTime last_diagnostics_time_;
 };
 
 } // namespace fcu_io
@@ -5,8 +5,10 @@
 
 namespace blackbox {
 
-Blackbox::Blackbox(std::string port, int baud_rate, BlackboxListener * const listener) :
-		serial_(port, baud_rate, this), listener_(listener) {
+Blackbox::Blackbox(const TransportOptions &options, BlackboxListener * const listener) :
+		listener_(listener) {
+	// The transport starts delivering data straight away, so only create it once listener_ is set
+	transport_.reset(create_transport(options, this));
 	//serial_.register_listener(this);
 	//  mavrosflight_->param.register_param_listener(this);
 }
@@ -15,8 +17,12 @@ Blackbox::~Blackbox() {
 
 }
 
-void Blackbox::serial_data_received(const uint8_t byte) {
-	listener_->handle_blackbox_message(byte);
+void Blackbox::serial_data_received(const uint8_t * const data, const size_t length, const uint64_t rx_time_us) {
+	listener_->handle_blackbox_message(data, length, rx_time_us);
+}
+
+void Blackbox::serial_connection_changed(const ConnectionState state, const ConnectionStats &stats) {
+	listener_->handle_connection_changed(state, stats);
 }
 
 void Blackbox::serial_data_send(float roll, float pitch, float yaw, float trottle) {
@@ -0,0 +1,206 @@
+#include <math.h>
+
+#include "blackbox/clock_sync.h"
+
+// Weight of a new residual in the running mean/variance
+#define CLOCK_SYNC_RESIDUAL_ALPHA (1.0 / 64)
+
+namespace blackbox {
+
+ClockSync::ClockSync(size_t window) :
+		samples_(window < CLOCK_SYNC_MIN_SAMPLES ? CLOCK_SYNC_MIN_SAMPLES : window), window_(samples_.size()), accepted_count_(0),
+		rejected_count_(0), reset_count_(0) {
+	reset();
+}
+
+void ClockSync::reset() {
+	seeded_ = false;
+	last_fc_time_ = 0;
+	last_fc_time_ext_ = 0;
+
+	seed(0);
+}
+
+void ClockSync::seed(const uint64_t host_time_us) {
+	fc_origin_ = last_fc_time_ext_;
+	host_origin_ = host_time_us;
+
+	next_ = 0;
+	count_ = 0;
+	bucket_open_ = false;
+	bucket_start_ = 0;
+
+	valid_ = false;
+	slope_ = 1.0;
+	intercept_ = 0;
+
+	residual_mean_ = 0;
+	residual_var_ = 0;
+	jitter_us_ = 0;
+	consecutive_rejects_ = 0;
+}
+
+bool ClockSync::add_sample(const uint32_t fc_time_us, const uint64_t host_time_us) {
+	if (!seeded_) {
+		seeded_ = true;
+		last_fc_time_ = fc_time_us;
+		last_fc_time_ext_ = fc_time_us;
+		seed(host_time_us);
+	} else {
+		const uint32_t delta = fc_time_us - last_fc_time_;
+
+		last_fc_time_ = fc_time_us;
+
+		if (delta & 0x80000000) {
+			// FC time ran backwards, so the FC has restarted and the old model means nothing
+			last_fc_time_ext_ = fc_time_us;
+			reset_count_++;
+			seed(host_time_us);
+		} else {
+			last_fc_time_ext_ += delta;
+		}
+	}
+
+	Sample sample;
+	sample.fc = (double) (last_fc_time_ext_ - fc_origin_);
+	sample.host = (double) (int64_t) (host_time_us - host_origin_);
+
+	if (valid_) {
+		const double deviation = sample.host - predict(sample.fc) - residual_mean_;
+		double limit = CLOCK_SYNC_REJECT_SIGMA * jitter_us_;
+
+		if (limit < CLOCK_SYNC_MIN_REJECT_US)
+			limit = CLOCK_SYNC_MIN_REJECT_US;
+
+		// While warming up the model is only the fastest sample so far, and an even faster one simply improves it
+		if (deviation > limit || (deviation < -limit && count_ >= CLOCK_SYNC_MIN_SAMPLES)) {
+			rejected_count_++;
+
+			if (++consecutive_rejects_ < CLOCK_SYNC_MAX_CONSECUTIVE_REJECTS)
+				return false;
+
+			// Everything has been off for a while now, the model is stale. Start over from this sample.
+			reset_count_++;
+			seed(host_time_us);
+			sample.fc = 0;
+			sample.host = 0;
+		} else {
+			residual_mean_ += CLOCK_SYNC_RESIDUAL_ALPHA * deviation;
+			residual_var_ += CLOCK_SYNC_RESIDUAL_ALPHA * (deviation * deviation - residual_var_);
+			jitter_us_ = sqrt(residual_var_);
+		}
+	}
+
+	consecutive_rejects_ = 0;
+	accepted_count_++;
+
+	if (bucket_open_ && sample.fc - bucket_start_ >= CLOCK_SYNC_BUCKET_US)
+		push_bucket();
+
+	if (!bucket_open_) {
+		bucket_open_ = true;
+		bucket_start_ = sample.fc;
+		bucket_min_ = sample;
+	} else if (sample.host - sample.fc < bucket_min_.host - bucket_min_.fc) {
+		bucket_min_ = sample;
+	}
+
+	// Until the drift can be estimated, follow the fastest sample seen assuming both clocks run at the same rate
+	if (count_ < CLOCK_SYNC_MIN_SAMPLES && (!valid_ || sample.host - sample.fc < intercept_))
+		intercept_ = sample.host - sample.fc;
+
+	valid_ = true;
+
+	return true;
+}
+
+void ClockSync::resume(const uint32_t fc_time_us) {
+	if (!seeded_)
+		return;
+
+	const uint32_t delta = fc_time_us - last_fc_time_;
+
+	if (delta & 0x80000000) {
+		reset_count_++;
+		reset();
+		return;
+	}
+
+	last_fc_time_ = fc_time_us;
+	last_fc_time_ext_ += delta;
+}
+
+uint64_t ClockSync::host_time(const uint32_t fc_time_us) const {
+	if (!valid_)
+		return 0;
+
+	// Relative to the latest sample, so that times slightly in the past don't look like a wrap
+	const int64_t fc = last_fc_time_ext_ + (int32_t) (fc_time_us - last_fc_time_) - fc_origin_;
+	const double host = predict((double) fc);
+
+	if (host < 0 && (uint64_t) -host > host_origin_)
+		return 0;
+
+	return host_origin_ + (int64_t) floor(host + 0.5);
+}
+
+double ClockSync::predict(const double fc) const {
+	return intercept_ + slope_ * fc;
+}
+
+void ClockSync::push_bucket() {
+	samples_[next_] = bucket_min_;
+	next_ = (next_ + 1) % window_;
+
+	if (count_ < window_)
+		count_++;
+
+	bucket_open_ = false;
+
+	if (count_ >= CLOCK_SYNC_MIN_SAMPLES)
+		fit();
+}
+
+void ClockSync::fit() {
+	double mean_fc = 0, mean_host = 0;
+
+	for (size_t i = 0; i < count_; i++) {
+		mean_fc += samples_[i].fc;
+		mean_host += samples_[i].host;
+	}
+
+	mean_fc /= count_;
+	mean_host /= count_;
+
+	// Centred sums, the raw values grow large enough over a long flight to lose precision in sum of squares form
+	double sxx = 0, sxy = 0;
+
+	for (size_t i = 0; i < count_; i++) {
+		const double dx = samples_[i].fc - mean_fc;
+
+		sxx += dx * dx;
+		sxy += dx * (samples_[i].host - mean_host);
+	}
+
+	double slope = sxx > 0 ? sxy / sxx : 1.0;
+
+	if (slope > 1.0 + CLOCK_SYNC_MAX_DRIFT_PPM * 1e-6)
+		slope = 1.0 + CLOCK_SYNC_MAX_DRIFT_PPM * 1e-6;
+	else if (slope < 1.0 - CLOCK_SYNC_MAX_DRIFT_PPM * 1e-6)
+		slope = 1.0 - CLOCK_SYNC_MAX_DRIFT_PPM * 1e-6;
+
+	// Slew towards the new fit at the newest bucket rather than stepping, so a refit doesn't show up in the stamps
+	const double anchor = samples_[(next_ + window_ - 1) % window_].fc;
+	const double before = predict(anchor);
+
+	slope_ = slope;
+	intercept_ = mean_host - slope * mean_fc;
+
+	const double step = predict(anchor) - before;
+
+	// Large steps are real corrections (first fit, or after an outage) and are taken at once
+	if (fabs(step) < CLOCK_SYNC_MIN_REJECT_US)
+		intercept_ -= step * (1.0 - CLOCK_SYNC_RESIDUAL_ALPHA * 8);
+}
+
+}
@@ -0,0 +1,822 @@
+#include "blackbox/decoders.h"
+#include "blackbox/tools.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TAG8_8SVB_SSSE3
+#include <tmmintrin.h>
+#endif
+
+// Longest encodings, if this many bytes are in the stream's window the value is decoded straight from memory
+#define TAG8_8SVB_MAX_BYTES (1 + 8 * 5)
+#define VB_MAX_BYTES 5
+
+// Window needed to decode the tagged groups from tables: the last field starts at most this far in, and is read with a 4 byte load
+#define TAG2_3S32_WINDOW_BYTES (1 + 2 * 4 + 4)
+#define TAG8_4S16_WINDOW_BYTES (1 + 3 * 2 + 4)
+
+// The last value of a TAG8_8SVB group may be decoded with a load of PARSER_INPUT_VB_LOAD_SIZE bytes
+#define TAG8_8SVB_WINDOW_BYTES (TAG8_8SVB_MAX_BYTES - VB_MAX_BYTES + PARSER_INPUT_VB_LOAD_SIZE)
+
+namespace {
+
+/**
+ * Byte source for the decoders below when the whole value is known to be in memory.
+ */
+struct PointerReader {
+	const uint8_t *pos;
+
+	explicit PointerReader(const uint8_t *p) :
+			pos(p) {
+	}
+
+	uint8_t readByte() {
+		return *pos++;
+	}
+
+	int32_t readSignedVB() {
+		uint32_t result;
+
+		pos = blackbox::ParserInputStream::decodeUnsignedVB(pos, &result);
+
+		return zigzagDecode(result);
+	}
+};
+
+/**
+ * Byte source that goes through the stream, for values that straddle a refill or run into the end of the data.
+ */
+struct StreamReader {
+	blackbox::ParserInputStream &pis;
+
+	explicit StreamReader(blackbox::ParserInputStream &p) :
+			pis(p) {
+	}
+
+	uint8_t readByte() {
+		return pis.streamReadByte();
+	}
+
+	int32_t readSignedVB() {
+		return pis.streamReadSignedVB();
+	}
+};
+
+template<typename Reader>
+void readTag2_3S32(Reader &pis, int32_t *values) {
+	uint8_t leadByte;
+	uint8_t byte1, byte2, byte3, byte4;
+	int i;
+
+	leadByte = pis.readByte();
+
+	// Check the selector in the top two bits to determine the field layout
+	switch (leadByte >> 6) {
+	case 0:
+		// 2-bit fields
+		values[0] = signExtend2Bit((leadByte >> 4) & 0x03);
+		values[1] = signExtend2Bit((leadByte >> 2) & 0x03);
+		values[2] = signExtend2Bit(leadByte & 0x03);
+		break;
+	case 1:
+		// 4-bit fields
+		values[0] = signExtend4Bit(leadByte & 0x0F);
+
+		leadByte = pis.readByte();
+
+		values[1] = signExtend4Bit(leadByte >> 4);
+		values[2] = signExtend4Bit(leadByte & 0x0F);
+		break;
+	case 2:
+		// 6-bit fields
+		values[0] = signExtend6Bit(leadByte & 0x3F);
+
+		leadByte = pis.readByte();
+		values[1] = signExtend6Bit(leadByte & 0x3F);
+
+		leadByte = pis.readByte();
+		values[2] = signExtend6Bit(leadByte & 0x3F);
+		break;
+	case 3:
+		// Fields are 8, 16 or 24 bits, read selector to figure out which field is which size
+
+		for (i = 0; i < 3; i++) {
+			switch (leadByte & 0x03) {
+			case 0: // 8-bit
+				byte1 = pis.readByte();
+
+				// Sign extend to 32 bits
+				values[i] = (int32_t) (int8_t) (byte1);
+				break;
+			case 1: // 16-bit
+				byte1 = pis.readByte();
+				byte2 = pis.readByte();
+
+				// Sign extend to 32 bits
+				values[i] = (int32_t) (int16_t) (byte1 | (byte2 << 8));
+				break;
+			case 2: // 24-bit
+				byte1 = pis.readByte();
+				byte2 = pis.readByte();
+				byte3 = pis.readByte();
+
+				values[i] = signExtend24Bit(byte1 | (byte2 << 8) | (byte3 << 16));
+				break;
+			case 3: // 32-bit
+				byte1 = pis.readByte();
+				byte2 = pis.readByte();
+				byte3 = pis.readByte();
+				byte4 = pis.readByte();
+
+				values[i] = (int32_t) (byte1 | (byte2 << 8) | (byte3 << 16) | (byte4 << 24));
+				break;
+			}
+
+			leadByte >>= 2;
+		}
+		break;
+	}
+}
+
+template<typename Reader>
+void readTag8_4S16_v1(Reader &pis, int32_t *values) {
+	uint8_t selector, combinedChar;
+	uint8_t char1, char2;
+	int i;
+
+	enum {
+		FIELD_ZERO = 0, FIELD_4BIT = 1, FIELD_8BIT = 2, FIELD_16BIT = 3
+	};
+
+	selector = pis.readByte();
+
+	//Read the 4 values from the stream
+	for (i = 0; i < 4; i++) {
+		switch (selector & 0x03) {
+		case FIELD_ZERO:
+			values[i] = 0;
+			break;
+		case FIELD_4BIT: // Two 4-bit fields
+			combinedChar = (uint8_t) pis.readByte();
+
+			values[i] = signExtend4Bit(combinedChar & 0x0F);
+
+			i++;
+			selector >>= 2;
+
+			values[i] = signExtend4Bit(combinedChar >> 4);
+			break;
+		case FIELD_8BIT: // 8-bit field
+			//Sign extend...
+			values[i] = (int32_t) (int8_t) pis.readByte();
+			break;
+		case FIELD_16BIT: // 16-bit field
+			char1 = pis.readByte();
+			char2 = pis.readByte();
+
+			//Sign extend...
+			values[i] = (int16_t) (char1 | (char2 << 8));
+			break;
+		}
+
+		selector >>= 2;
+	}
+}
+
+template<typename Reader>
+void readTag8_4S16_v2(Reader &pis, int32_t *values) {
+	uint8_t selector;
+	uint8_t char1, char2;
+	uint8_t buffer;
+	int nibbleIndex;
+
+	int i;
+
+	enum {
+		FIELD_ZERO = 0, FIELD_4BIT = 1, FIELD_8BIT = 2, FIELD_16BIT = 3
+	};
+
+	selector = pis.readByte();
+
+	//Read the 4 values from the stream
+	nibbleIndex = 0;
+	for (i = 0; i < 4; i++) {
+		switch (selector & 0x03) {
+		case FIELD_ZERO:
+			values[i] = 0;
+			break;
+		case FIELD_4BIT:
+			if (nibbleIndex == 0) {
+				buffer = (uint8_t) pis.readByte();
+				values[i] = signExtend4Bit(buffer >> 4);
+				nibbleIndex = 1;
+			} else {
+				values[i] = signExtend4Bit(buffer & 0x0F);
+				nibbleIndex = 0;
+			}
+			break;
+		case FIELD_8BIT:
+			if (nibbleIndex == 0) {
+				//Sign extend...
+				values[i] = (int32_t) (int8_t) pis.readByte();
+			} else {
+				char1 = buffer << 4;
+				buffer = (uint8_t) pis.readByte();
+
+				char1 |= buffer >> 4;
+				values[i] = (int32_t) (int8_t) char1;
+			}
+			break;
+		case FIELD_16BIT:
+			if (nibbleIndex == 0) {
+				char1 = (uint8_t) pis.readByte();
+				char2 = (uint8_t) pis.readByte();
+
+				//Sign extend...
+				values[i] = (int16_t) (uint16_t) ((char1 << 8) | char2);
+			} else {
+				/*
+				 * We're in the low 4 bits of the current buffer, then one byte, then the high 4 bits of the next
+				 * buffer.
+				 */
+				char1 = (uint8_t) pis.readByte();
+				char2 = (uint8_t) pis.readByte();
+
+				values[i] = (int16_t) (uint16_t) ((buffer << 12) | (char1 << 4) | (char2 >> 4));
+
+				buffer = char2;
+			}
+			break;
+		}
+
+		selector >>= 2;
+	}
+}
+
+template<typename Reader>
+void readTag8_8SVB(Reader &pis, int32_t *values) {
+	uint8_t header = pis.readByte();
+
+	for (int i = 0; i < 8; i++, header >>= 1)
+		values[i] = (header & 0x01) ? pis.readSignedVB() : 0;
+}
+
+/**
+ * Where the fields of a tagged group are, for one value of its selector byte. Field i is read with a 32 bit load at
+ * offset[i] from the selector, shifted left by left[i] to drop the bits before it and arithmetically right by
+ * right[i] to sign extend it, then masked with keep[i] (0 for fields that are not stored, so read as zero).
+ */
+struct TagLayout {
+	int32_t keep[4];
+	uint8_t offset[4];
+	uint8_t left[4];
+	uint8_t right[4];
+	uint8_t length;
+
+	void setField(int field, int fieldOffset, int skipBits, int bits) {
+		keep[field] = -1;
+		offset[field] = fieldOffset;
+		left[field] = skipBits;
+		right[field] = 32 - bits;
+	}
+};
+
+/**
+ * Layouts of TAG2_3S32 and both versions of TAG8_4S16 for every selector byte, built once at startup.
+ *
+ * TAG2_3S32 and TAG8_4S16 v1 store little-endian fields, so fields are located counting from the least significant
+ * bit of a little-endian load. TAG8_4S16 v2 packs nibble aligned big-endian fields, so from the most significant bit
+ * of a big-endian one.
+ */
+struct TagLayoutTables {
+	TagLayout tag2_3S32[256];
+	TagLayout tag8_4S16_v1[256];
+	TagLayout tag8_4S16_v2[256];
+
+	TagLayoutTables() {
+		memset(this, 0, sizeof(*this));
+
+		for (int selector = 0; selector < 256; selector++) {
+			buildTag2_3S32(tag2_3S32[selector], selector);
+			buildTag8_4S16_v1(tag8_4S16_v1[selector], selector);
+			buildTag8_4S16_v2(tag8_4S16_v2[selector], selector);
+		}
+	}
+
+	static void buildTag2_3S32(TagLayout &layout, uint8_t leadByte) {
+		int offset = 1;
+
+		switch (leadByte >> 6) {
+		case 0:
+			// 2-bit fields in the lead byte
+			layout.setField(0, 0, 32 - 6, 2);
+			layout.setField(1, 0, 32 - 4, 2);
+			layout.setField(2, 0, 32 - 2, 2);
+			layout.length = 1;
+			break;
+		case 1:
+			// 4-bit fields, the low nibble of the lead byte then the high and low nibbles of the next
+			layout.setField(0, 0, 32 - 4, 4);
+			layout.setField(1, 1, 32 - 8, 4);
+			layout.setField(2, 1, 32 - 4, 4);
+			layout.length = 2;
+			break;
+		case 2:
+			// 6-bit fields, the low bits of three bytes
+			for (int i = 0; i < 3; i++)
+				layout.setField(i, i, 32 - 6, 6);
+			layout.length = 3;
+			break;
+		case 3:
+			// 1 to 4 byte fields, sized by pairs of bits of the lead byte
+			for (int i = 0; i < 3; i++, leadByte >>= 2) {
+				const int bytes = (leadByte & 0x03) + 1;
+
+				layout.setField(i, offset, 32 - bytes * 8, bytes * 8);
+				offset += bytes;
+			}
+			layout.length = offset;
+			break;
+		}
+	}
+
+	static void buildTag8_4S16_v1(TagLayout &layout, uint8_t selector) {
+		int offset = 1;
+
+		for (int i = 0; i < 4; i++, selector >>= 2) {
+			switch (selector & 0x03) {
+			case 0: // Zero
+				break;
+			case 1: // Two 4-bit fields in one byte, taking the selector bits of the next field too
+				layout.setField(i, offset, 32 - 4, 4);
+
+				if (++i < 4)
+					layout.setField(i, offset, 32 - 8, 4);
+
+				selector >>= 2;
+				offset++;
+				break;
+			case 2: // 8-bit
+				layout.setField(i, offset, 32 - 8, 8);
+				offset++;
+				break;
+			case 3: // 16-bit
+				layout.setField(i, offset, 32 - 16, 16);
+				offset += 2;
+				break;
+			}
+		}
+
+		layout.length = offset;
+	}
+
+	static void buildTag8_4S16_v2(TagLayout &layout, uint8_t selector) {
+		static const int fieldBits[4] = { 0, 4, 8, 16 };
+		int bitOffset = 8;
+
+		for (int i = 0; i < 4; i++, selector >>= 2) {
+			const int bits = fieldBits[selector & 0x03];
+
+			if (bits) {
+				layout.setField(i, bitOffset / 8, bitOffset % 8, bits);
+				bitOffset += bits;
+			}
+		}
+
+		layout.length = (bitOffset + 7) / 8;
+	}
+};
+
+const TagLayoutTables tagLayoutTables;
+
+/**
+ * Decode the fields of a tagged group at p with a fixed sequence of loads, returning the address just past it. The
+ * last field's 4 byte load may read up to 3 bytes beyond the group.
+ */
+template<int FieldCount, bool BigEndian>
+const uint8_t* decodeTagLayout(const uint8_t *p, const TagLayout &layout, int32_t *values) {
+	for (int i = 0; i < FieldCount; i++) {
+		uint32_t word;
+
+		memcpy(&word, p + layout.offset[i], sizeof(word));
+		word = BigEndian ? be32toh(word) : le32toh(word);
+
+		values[i] = ((int32_t) (word << layout.left[i]) >> layout.right[i]) & layout.keep[i];
+	}
+
+	return p + layout.length;
+}
+
+#ifdef TAG8_8SVB_SSSE3
+
+// Bytes the vector decoder may load past the group header: a second 16 byte load starts at most 8 bytes in
+#define TAG8_8SVB_SSSE3_WINDOW_BYTES (1 + 8 + 16)
+
+/**
+ * Shuffle tables for decoding a TAG8_8SVB group whose values are all 1 or 2 bytes long, built once at startup along
+ * with the check for SSSE3 support.
+ */
+struct Tag8_8SVBTables {
+	/*
+	 * Keyed by the continuation bits of 8 bytes: how to gather up to 4 values from them into 16 bit lanes, how many of
+	 * them parse as 1 or 2 byte values, and the bytes taken by the first n of those.
+	 */
+	struct Half {
+		uint8_t shuffle[16];
+		uint8_t valid;
+		uint8_t length[5];
+	} half[256];
+
+	// Keyed by the group header: moves the packed values out to the lanes of the fields that are present
+	uint8_t expand[256][16];
+
+	bool supported;
+
+	Tag8_8SVBTables() {
+		for (int key = 0; key < 256; key++) {
+			Half &h = half[key];
+			int offset = 0;
+
+			memset(h.shuffle, 0x80, sizeof(h.shuffle));
+			h.valid = 0;
+			h.length[0] = 0;
+
+			for (int i = 0; i < 4; i++) {
+				int length;
+
+				if (offset < 8 && !(key & (1 << offset)))
+					length = 1;
+				else if (offset < 7 && !(key & (1 << (offset + 1))))
+					length = 2;
+				else
+					break;
+
+				h.shuffle[i * 2] = offset;
+				if (length == 2)
+					h.shuffle[i * 2 + 1] = offset + 1;
+
+				offset += length;
+				h.valid = i + 1;
+				h.length[i + 1] = offset;
+			}
+		}
+
+		for (int header = 0; header < 256; header++) {
+			int rank = 0;
+
+			for (int i = 0; i < 8; i++) {
+				if (header & (1 << i)) {
+					expand[header][i * 2] = rank * 2;
+					expand[header][i * 2 + 1] = rank * 2 + 1;
+					rank++;
+				} else {
+					expand[header][i * 2] = 0x80;
+					expand[header][i * 2 + 1] = 0x80;
+				}
+			}
+		}
+
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports("ssse3");
+	}
+};
+
+const Tag8_8SVBTables tag8_8SVBTables;
+
+/**
+ * Decode a TAG8_8SVB group at p with SSSE3 shuffles when every value in it is 1 or 2 bytes long, as most PID and motor
+ * deltas are. Returns the address just past the group, or NULL without touching values if the group has longer
+ * values and has to be decoded one value at a time. TAG8_8SVB_SSSE3_WINDOW_BYTES must be readable at p.
+ */
+__attribute__((target("ssse3")))
+const uint8_t* readTag8_8SVB_ssse3(const uint8_t *p, int32_t *values) {
+	const Tag8_8SVBTables &tables = tag8_8SVBTables;
+	const uint8_t header = *p++;
+	const int count = __builtin_popcount(header);
+	const int firstCount = count < 4 ? count : 4;
+
+	// The first (up to) 4 values
+	const __m128i first = _mm_loadu_si128((const __m128i*) p);
+	const Tag8_8SVBTables::Half &firstHalf = tables.half[_mm_movemask_epi8(first) & 0xFF];
+
+	if (firstHalf.valid < firstCount)
+		return NULL;
+
+	__m128i packed = _mm_shuffle_epi8(first, _mm_loadu_si128((const __m128i*) firstHalf.shuffle));
+	int length = firstHalf.length[firstCount];
+
+	// And the rest
+	if (count > 4) {
+		const __m128i second = _mm_loadu_si128((const __m128i*) (p + length));
+		const Tag8_8SVBTables::Half &secondHalf = tables.half[_mm_movemask_epi8(second) & 0xFF];
+
+		if (secondHalf.valid < count - 4)
+			return NULL;
+
+		packed = _mm_unpacklo_epi64(packed, _mm_shuffle_epi8(second, _mm_loadu_si128((const __m128i*) secondHalf.shuffle)));
+		length += secondHalf.length[count - 4];
+	}
+
+	// Join the 7 bit groups of each 16 bit lane, then spread the lanes out to their fields
+	packed = _mm_or_si128(_mm_and_si128(packed, _mm_set1_epi16(0x007F)), _mm_srli_epi16(_mm_and_si128(packed, _mm_set1_epi16(0x7F00)), 1));
+	packed = _mm_shuffle_epi8(packed, _mm_loadu_si128((const __m128i*) tables.expand[header]));
+
+	// Widen to 32 bits and zigzag decode: (u >> 1) ^ -(u & 1)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi32(1);
+	__m128i low = _mm_unpacklo_epi16(packed, zero);
+	__m128i high = _mm_unpackhi_epi16(packed, zero);
+
+	low = _mm_xor_si128(_mm_srli_epi32(low, 1), _mm_sub_epi32(zero, _mm_and_si128(low, one)));
+	high = _mm_xor_si128(_mm_srli_epi32(high, 1), _mm_sub_epi32(zero, _mm_and_si128(high, one)));
+
+	_mm_storeu_si128((__m128i*) values, low);
+	_mm_storeu_si128((__m128i*) (values + 4), high);
+
+	return p + length;
+}
+
+#endif
+
+/**
+ * Decode from the window when the longest encoding fits in it, otherwise byte by byte through the stream.
+ */
+#define DECODE_FROM_WINDOW(pis, maxBytes, decoder, values) \
+	do { \
+		if ((pis).streamAvailable() >= (maxBytes)) { \
+			PointerReader reader((pis).streamPointer()); \
+			decoder(reader, values); \
+			(pis).streamSkip(reader.pos - (pis).streamPointer()); \
+		} else { \
+			StreamReader reader(pis); \
+			decoder(reader, values); \
+		} \
+	} while (0)
+
+}
+
+void streamReadTag2_3S32(blackbox::ParserInputStream &pis, int32_t *values) {
+	if (pis.streamAvailable() >= TAG2_3S32_WINDOW_BYTES) {
+		const uint8_t *p = pis.streamPointer();
+
+		pis.streamSkip(decodeTagLayout<3, false>(p, tagLayoutTables.tag2_3S32[*p], values) - p);
+	} else {
+		StreamReader reader(pis);
+		readTag2_3S32(reader, values);
+	}
+}
+
+void streamReadTag8_4S16_v1(blackbox::ParserInputStream &pis, int32_t *values) {
+	if (pis.streamAvailable() >= TAG8_4S16_WINDOW_BYTES) {
+		const uint8_t *p = pis.streamPointer();
+
+		pis.streamSkip(decodeTagLayout<4, false>(p, tagLayoutTables.tag8_4S16_v1[*p], values) - p);
+	} else {
+		StreamReader reader(pis);
+		readTag8_4S16_v1(reader, values);
+	}
+}
+
+void streamReadTag8_4S16_v2(blackbox::ParserInputStream &pis, int32_t *values) {
+	if (pis.streamAvailable() >= TAG8_4S16_WINDOW_BYTES) {
+		const uint8_t *p = pis.streamPointer();
+
+		pis.streamSkip(decodeTagLayout<4, true>(p, tagLayoutTables.tag8_4S16_v2[*p], values) - p);
+	} else {
+		StreamReader reader(pis);
+		readTag8_4S16_v2(reader, values);
+	}
+}
+
+void streamReadTag8_8SVB(blackbox::ParserInputStream &pis, int32_t *values, int valueCount) {
+	if (valueCount == 1) {
+		values[0] = pis.streamReadSignedVB();
+	} else {
+#ifdef TAG8_8SVB_SSSE3
+		if (tag8_8SVBTables.supported && pis.streamAvailable() >= TAG8_8SVB_SSSE3_WINDOW_BYTES) {
+			const uint8_t *end = readTag8_8SVB_ssse3(pis.streamPointer(), values);
+
+			if (end) {
+				pis.streamSkip(end - pis.streamPointer());
+				return;
+			}
+		}
+#endif
+
+		DECODE_FROM_WINDOW(pis, TAG8_8SVB_WINDOW_BYTES, readTag8_8SVB, values);
+	}
+}
+
+float streamReadRawFloat(blackbox::ParserInputStream &pis) {
+	union floatConvert_t {
+		float f;
+		uint8_t bytes[4];
+	} floatConvert;
+
+	floatConvert.f = 0;
+	pis.streamRead(floatConvert.bytes, sizeof(floatConvert.bytes));
+
+	return floatConvert.f;
+}
+
+int16_t streamReadS16(blackbox::ParserInputStream &pis) {
+	// Two statements, the evaluation order of the operands of | is unspecified
+	uint8_t low = pis.streamReadByte();
+
+	return low | (pis.streamReadByte() << 8);
+}
+
+/**
+ * Decode an Elias-Delta value straight from the stream's bit reservoir, finding the length prefix with one count of
+ * leading zeros. Returns false without consuming anything if the code isn't entirely in the reservoir (close to the end
+ * of the window) or is one of the rare or corrupt forms best left to the bit-by-bit decoder.
+ */
+static bool readEliasDeltaFast(blackbox::ParserInputStream &pis, uint32_t *value) {
+	uint64_t bits;
+	const int available = pis.streamPeekBits(&bits);
+
+	if (bits == 0)
+		return false;
+
+	const int lengthValBits = __builtin_clzll(bits);
+	const int prefixBits = 2 * lengthValBits + 1;
+
+	if (prefixBits > available)
+		return false;
+
+	// The prefix read as a number is the length field with its implicit leading 1
+	const uint32_t length = (uint32_t) (bits >> (64 - prefixBits)) - 1;
+
+	if (length > 31)
+		return false;
+
+	const int totalBits = prefixBits + length;
+
+	// Leave room for the escape bit too
+	if (totalBits + 1 > available)
+		return false;
+
+	const uint32_t result = (1U << length) | (uint32_t) ((bits >> (64 - totalBits)) & ((1U << length) - 1));
+
+	if (result == 0xFFFFFFFF) {
+		*value = (bits >> (63 - totalBits)) & 1 ? 0xFFFFFFFF : 0xFFFFFFFF - 1;
+		pis.streamSkipBits(totalBits + 1);
+	} else {
+		*value = result - 1;
+		pis.streamSkipBits(totalBits);
+	}
+
+	return true;
+}
+
+/**
+ * Read an Elias-Delta encoded 32-bit unsigned integer from the bitstream and return it. If EOF is encountered during
+ * reading, 0 is returned and the stream's EOF flag is set.
+ *
+ * If eof is not reached, the stream's bit pointer is not necessarily aligned on a byte boundary after this routine
+ * returns, so if you want to read a byte value later you must call streamByteAlign() first.
+ */
+uint32_t streamReadEliasDeltaU32(blackbox::ParserInputStream &pis) {
+	/* We can only read 32 bits from the bitstream at a time, but this is fine because valid Elias Delta 32-bit values
+	 * never require this many bits to be read in one call.
+	 */
+	const int MAX_BIT_READ_SIZE = 32;
+
+	int lengthValBits = 0;
+	uint8_t length;
+	uint32_t lengthLowBits, resultLowBits;
+	uint32_t result;
+
+	if (readEliasDeltaFast(pis, &result))
+		return result;
+
+	while (lengthValBits <= MAX_BIT_READ_SIZE && pis.streamReadBit() == 0) {
+		lengthValBits++;
+	}
+
+	if (pis.streamEof() || lengthValBits > MAX_BIT_READ_SIZE) {
+		return 0;
+	}
+
+	// Now we know the length of the field used to store the length of the encoded value, so read those length bits
+	lengthLowBits = pis.streamReadBits(lengthValBits);
+
+	if (pis.streamEof()) {
+		return 0;
+	}
+
+	length = ((1 << lengthValBits) | lengthLowBits) - 1;
+
+	if (length > MAX_BIT_READ_SIZE) {
+		//Corrupt value
+		return 0;
+	}
+
+	// Now we know the length of the encoded value, so read those bits
+	resultLowBits = pis.streamReadBits(length);
+
+	if (pis.streamEof()) {
+		return 0;
+	}
+
+	result = (1 << length) | resultLowBits;
+
+	// The highest value is an escape code that means either MAXINT - 1 or MAXINT depending on the following bit
+	if (result == 0xFFFFFFFF) {
+		int escapeVal = pis.streamReadBit();
+
+		if (escapeVal == 0) {
+			return 0xFFFFFFFF - 1;
+		} else if (escapeVal == 1) {
+			return 0xFFFFFFFF;
+		} else {
+			//EOF
+			return 0;
+		}
+	}
+
+	return result - 1;
+}
+
+int32_t streamReadEliasDeltaS32(blackbox::ParserInputStream &pis) {
+	return zigzagDecode(streamReadEliasDeltaU32(pis));
+}
+
+/**
+ * Elias-Gamma counterpart of readEliasDeltaFast().
+ */
+static bool readEliasGammaFast(blackbox::ParserInputStream &pis, uint32_t *value) {
+	uint64_t bits;
+	const int available = pis.streamPeekBits(&bits);
+
+	if (bits == 0)
+		return false;
+
+	const int valBits = __builtin_clzll(bits);
+
+	// The code is valBits zeros followed by valBits bits of value, short of the escaped maximum
+	if (valBits == 0 || 2 * valBits >= available)
+		return false;
+
+	*value = (uint32_t) (bits >> (64 - 2 * valBits)) - 1;
+	pis.streamSkipBits(2 * valBits);
+
+	return true;
+}
+
+/**
+ * Read an Elias-Gamma encoded 32-bit unsigned integer from the bitstream and return it. If EOF is encountered during
+ * reading, 0 is returned and the stream's EOF flag is set.
+ *
+ * If eof is not reached, the stream's bit pointer is not necessarily aligned on a byte boundary after this routine
+ * returns, so if you want to read a byte value later you must call streamByteAlign() first.
+ */
+uint32_t streamReadEliasGammaU32(blackbox::ParserInputStream &pis) {
+	/* We can only read 32 bits from the bitstream at a time, but this is fine because valid Elias Gamma 32-bit values
+	 * never require this many bits to be read in one call.
+	 */
+	const int MAX_BIT_READ_SIZE = 32;
+
+	int valBits = 0;
+	uint32_t valueLowBits;
+	uint32_t result;
+
+	if (readEliasGammaFast(pis, &result))
+		return result;
+
+	while (valBits <= MAX_BIT_READ_SIZE && pis.streamReadBit() == 0) {
+		valBits++;
+	}
+
+	if (pis.streamEof() || valBits > MAX_BIT_READ_SIZE) {
+		return 0;
+	}
+
+	// We've read the first 1 bit of the encoded value, now read the rest of the bits
+	valueLowBits = pis.streamReadBits(valBits - 1);
+
+	if (pis.streamEof()) {
+		return 0;
+	}
+
+	result = (1 << (valBits - 1)) | valueLowBits;
+
+	// The highest value is an escape code that means either MAXINT - 1 or MAXINT depending on the following bit
+	if (result == 0xFFFFFFFF) {
+		int escapeVal = pis.streamReadBit();
+
+		if (escapeVal == 0) {
+			return 0xFFFFFFFF - 1;
+		} else if (escapeVal == 1) {
+			return 0xFFFFFFFF;
+		} else {
+			//EOF
+			return 0;
+		}
+	}
+
+	return result - 1;
+}
+
+int32_t streamReadEliasGammaS32(blackbox::ParserInputStream &pis) {
+	return zigzagDecode(streamReadEliasGammaU32(pis));
+}
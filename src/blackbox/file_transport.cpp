@@ -0,0 +1,77 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <blackbox/file_transport.h>
+
+namespace blackbox {
+
+FileTransport::FileTransport(const std::string &path, int baud_rate, SerialListener * const listener, size_t read_size) :
+		Transport(listener, read_size), fd_(-1), bytes_per_second_(baud_rate / 10), timer_(io_service_), bytes_replayed_(0) {
+	fd_ = open(path.c_str(), O_RDONLY);
+
+	if (fd_ < 0)
+		throw SerialException("Failed to open " + path + ": " + strerror(errno));
+
+	replay_start_ = boost::posix_time::microsec_clock::universal_time();
+
+	start();
+}
+
+FileTransport::~FileTransport() {
+	close();
+}
+
+bool FileTransport::is_open() {
+	return fd_ >= 0;
+}
+
+void FileTransport::async_read_some(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) {
+	// The chunk read before this one may not be in the ring yet
+	if (rx_ring_free() < SERIAL_READ_BUFFERS * boost::asio::buffer_size(buffer)) {
+		// The decoder is behind, wait for it instead of overflowing the ring
+		timer_.expires_from_now(boost::posix_time::milliseconds(1));
+		timer_.async_wait(boost::bind(&FileTransport::async_read_some, this, buffer, handler));
+		return;
+	}
+
+	if (bytes_per_second_ > 0) {
+		boost::posix_time::ptime due = replay_start_ + boost::posix_time::microseconds(bytes_replayed_ * 1000000 / bytes_per_second_);
+
+		if (due > boost::posix_time::microsec_clock::universal_time()) {
+			timer_.expires_at(due);
+			timer_.async_wait(boost::bind(&FileTransport::read_chunk, this, buffer, handler));
+			return;
+		}
+	}
+
+	read_chunk(buffer, handler);
+}
+
+void FileTransport::read_chunk(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) {
+	ssize_t bytes_read = read(fd_, boost::asio::buffer_cast<void*>(buffer), boost::asio::buffer_size(buffer));
+
+	if (bytes_read < 0) {
+		io_service_.post(boost::bind(handler, boost::system::error_code(errno, boost::system::system_category()), 0));
+	} else if (bytes_read == 0) {
+		io_service_.post(boost::bind(handler, boost::asio::error::eof, 0));
+	} else {
+		bytes_replayed_ += bytes_read;
+		io_service_.post(boost::bind(handler, boost::system::error_code(), bytes_read));
+	}
+}
+
+void FileTransport::async_write(const WriteBuffers &buffers, const IoHandler &handler) {
+	io_service_.post(boost::bind(handler, boost::system::error_code(), boost::asio::buffer_size(buffers)));
+}
+
+void FileTransport::close_device() {
+	boost::system::error_code ignored;
+	timer_.cancel(ignored);
+
+	::close(fd_);
+	fd_ = -1;
+}
+
+}
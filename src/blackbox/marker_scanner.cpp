@@ -0,0 +1,56 @@
+#include <string.h>
+
+#include "blackbox/marker_scanner.h"
+
+#ifdef __SSE2__
+#define MARKER_SCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace blackbox {
+
+MarkerScanner::MarkerScanner() :
+		markerCount_(0) {
+	memset(isMarker_, 0, sizeof(isMarker_));
+}
+
+void MarkerScanner::addMarker(uint8_t marker) {
+	if (isMarker_[marker] || markerCount_ >= MARKER_SCANNER_MAX_MARKERS)
+		return;
+
+	markers_[markerCount_++] = marker;
+	isMarker_[marker] = true;
+}
+
+size_t MarkerScanner::find(const uint8_t *data, size_t length) const {
+	size_t i = 0;
+
+#ifdef MARKER_SCANNER_SSE2
+	__m128i markers[MARKER_SCANNER_MAX_MARKERS];
+
+	for (int m = 0; m < markerCount_; m++)
+		markers[m] = _mm_set1_epi8((char) markers_[m]);
+
+	// Compare 16 bytes against every marker at once, the first set bit of the mask is the first marker among them
+	for (; i + 16 <= length; i += 16) {
+		const __m128i bytes = _mm_loadu_si128((const __m128i*) (data + i));
+		__m128i found = _mm_setzero_si128();
+
+		for (int m = 0; m < markerCount_; m++)
+			found = _mm_or_si128(found, _mm_cmpeq_epi8(bytes, markers[m]));
+
+		const int mask = _mm_movemask_epi8(found);
+
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+
+	for (; i < length; i++)
+		if (isMarker_[data[i]])
+			return i;
+
+	return length;
+}
+
+}
@@ -22,6 +22,8 @@
 #include "blackbox/parser.h"
 #include "blackbox/tools.h"
 #include "blackbox/decoders.h"
+#include "blackbox/monotonic_time.h"
+#include "blackbox/predictors.h"
 
 namespace blackbox {
 
@@ -33,19 +35,11 @@ namespace blackbox {
 //Likewise for iteration count
 #define MAXIMUM_ITERATION_JUMP_BETWEEN_FRAMES (500 * 10)
 
-static void parseIntraframe(Parser &parser, bool raw);
-static void parseInterframe(Parser &parser, bool raw);
-static void parseGPSFrame(Parser &parser, bool raw);
-static void parseGPSHomeFrame(Parser &parser, bool raw);
-static void parseEventFrame(Parser &parser, bool raw);
-static void parseSlowFrame(Parser &parser, bool raw);
+// First line of a header snapshot file, followed by the header hash, see saveHeaderSnapshot()
+#define HEADER_SNAPSHOT_MAGIC "# Blackbox header snapshot"
 
-static bool completeIntraframe(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw);
-static bool completeInterframe(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw);
-static bool completeEventFrame(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw);
-static bool completeGPSFrame(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw);
-static bool completeGPSHomeFrame(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw);
-static bool completeSlowFrame(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw);
+#define FNV1A_64_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV1A_64_PRIME 0x100000001b3ULL
 
 static void resetSysConfigToDefaults(Parser::flightLogSysConfig_t *config) {
 	config->minthrottle = 1150;
@@ -71,8 +65,16 @@ static void resetSysConfigToDefaults(Parser::flightLogSysConfig_t *config) {
 }
 
 Parser::Parser(ParserInputStream &pis) :
-		pis_(pis), looksLikeFrameCompleted_(false), prematureEof_(false), gpsHomeIsValid_(false) {
+		feedSource_(NULL), feedStream_(NULL), pis_(pis), earlyCommit_(false) {
+	init();
+}
+
+Parser::Parser() :
+		feedSource_(new FeedInputSource()), feedStream_(new ParserInputStream(*feedSource_)), pis_(*feedStream_), earlyCommit_(false) {
+	init();
+}
 
+void Parser::init() {
 	frameTypes_[0].marker = 'I';
 	frameTypes_[0].parse = parseIntraframe;
 	frameTypes_[0].complete = completeIntraframe;
@@ -92,9 +94,43 @@ Parser::Parser(ParserInputStream &pis) :
 	frameTypes_[5].parse = parseSlowFrame;
 	frameTypes_[5].complete = completeSlowFrame;
 
+	memset(frameDefs_, 0, sizeof(frameDefs_));
+	memset(frameTypeByMarker_, 0, sizeof(frameTypeByMarker_));
+
+	for (int i = 0; i < (int) ARRAY_LENGTH(frameTypes_); i++) {
+		frameTypes_[i].def = &frameDefs_[i];
+		frameTypeByMarker_[frameTypes_[i].marker] = &frameTypes_[i];
+		markerScanner_.addMarker(frameTypes_[i].marker);
+	}
+
+	statsLevel_ = STATS_OFF;
+	frameSizeCounts_ = NULL;
+
+	headerText_ = NULL;
+	headerTextCapacity_ = 0;
+
+	// Field statistics are gathered in blocks that can take in fields past the last one decoded
+	memset(blackboxHistoryRing_, 0, sizeof(blackboxHistoryRing_));
+
+	resetLog();
+}
+
+/**
+ * Forget everything learnt from the header and the frames of the current log, ready for the header of the next one.
+ * The clock sync estimate carries on, the FC clock doesn't restart with a new log.
+ */
+void Parser::resetLog() {
+	freeFrameDefs();
+	resetStats();
+
+	dataVersion_ = 0;
+	readTag8_4S16_ = streamReadTag8_4S16_v1;
+
 	mainHistory_[0] = blackboxHistoryRing_[0];
 	mainHistory_[1] = NULL;
 	mainHistory_[2] = NULL;
+	mainStreamIsValid_ = false;
+	gpsHomeIsValid_ = false;
 
 	resetSysConfigToDefaults(&sysConfig_);
 
@@ -102,6 +138,9 @@ Parser::Parser(ParserInputStream &pis) :
 	frameIntervalPNum_ = 1;
 	frameIntervalPDenom_ = 1;
 
+	headerTextLength_ = 0;
+	headerHash_ = FNV1A_64_OFFSET_BASIS;
+
 	lastEvent_.event = FLIGHT_LOG_EVENT_UNINITIALIZED;
 
 	/*
@@ -111,31 +150,152 @@ Parser::Parser(ParserInputStream &pis) :
 	memset(&mainFieldIndexes_, (char) 0xFF, sizeof(mainFieldIndexes_));
 	memset(&gpsFieldIndexes_, (char) 0xFF, sizeof(gpsFieldIndexes_));
 	memset(&gpsHomeFieldIndexes_, (char) 0xFF, sizeof(gpsHomeFieldIndexes_));
+	memset(&slowFieldIndexes_, (char) 0xFF, sizeof(slowFieldIndexes_));
 
 	lastSkippedFrames_ = 0;
 	lastMainFrameIteration_ = (uint32_t) -1;
 	lastMainFrameTime_ = (uint32_t) -1;
+	mainReferencePending_ = false;
+
+	looksLikeFrameCompleted_ = false;
+	prematureEof_ = false;
+
+	decodeError_ = DECODE_OK;
+	decodeErrorsWarned_ = 0;
+
+	parserState_ = PARSER_STATE_HEADER;
+	lastFrameType_ = NULL;
+	lastFrameCommitted_ = false;
+	lastFrameAccepted_ = false;
+	committedMainFrameIteration_ = (uint32_t) -1;
+	committedMainFrameTime_ = (uint32_t) -1;
+	committedMainReferencePending_ = false;
+	clockSamplePending_ = false;
+	frameStart_ = 0;
+	logEnded_ = false;
+
+	resyncing_ = false;
+}
+
+/**
+ * Start the statistics over, with the histograms the stats level asks for.
+ */
+void Parser::resetStats() {
+	memset(&stats_, 0, sizeof(stats_));
+
+	if (frameSizeCounts_) {
+		memset(frameSizeCounts_, 0, ARRAY_LENGTH(frameTypes_) * (FLIGHT_LOG_MAX_FRAME_LENGTH + 1) * sizeof(*frameSizeCounts_));
+
+		for (int i = 0; i < (int) ARRAY_LENGTH(frameTypes_); i++)
+			stats_.frame[frameTypes_[i].marker].sizeCount = frameSizeCounts_ + i * (FLIGHT_LOG_MAX_FRAME_LENGTH + 1);
+	}
+
+	for (int i = 0; i < FLIGHT_LOG_MAX_FIELDS; i++) {
+		fieldMinKeys_[i] = INT32_MAX;
+		fieldMaxKeys_[i] = INT32_MIN;
+	}
+}
+
+void Parser::setStatsLevel(StatsLevel level) {
+	statsLevel_ = level;
+
+	free(frameSizeCounts_);
+	frameSizeCounts_ = NULL;
+
+	if (level == STATS_FULL)
+		frameSizeCounts_ = (uint32_t*) malloc(ARRAY_LENGTH(frameTypes_) * (FLIGHT_LOG_MAX_FRAME_LENGTH + 1) * sizeof(*frameSizeCounts_));
+
+	resetStats();
+}
+
+const Parser::flightLogStatistics_t& Parser::stats() {
+	const flightLogFrameDef_t *frameDef = this->frameDef('I');
+
+	if (stats_.haveFieldStats) {
+		for (int i = 0; i < frameDef->fieldCount; i++) {
+			if (fieldKeyBiases_[i] == 0) {
+				stats_.field[i].min = fieldMinKeys_[i];
+				stats_.field[i].max = fieldMaxKeys_[i];
+			} else {
+				stats_.field[i].min = (uint32_t) (fieldMinKeys_[i] ^ INT32_MIN);
+				stats_.field[i].max = (uint32_t) (fieldMaxKeys_[i] ^ INT32_MIN);
+			}
+		}
+	}
+
+	return stats_;
 }
 
 Parser::~Parser() {
+	freeFrameDefs();
+	free(frameSizeCounts_);
+	free(headerText_);
+
+	delete feedStream_;
+	delete feedSource_;
+}
+
+/**
+ * Forget all frame definitions, leaving them empty.
+ */
+void Parser::freeFrameDefs() {
+	for (int i = 0; i < (int) ARRAY_LENGTH(frameDefs_); i++) {
+		free(frameDefs_[i].namesLine);
+		free(frameDefs_[i].fieldName);
+		free(frameDefs_[i].fieldSigned);
+		free(frameDefs_[i].predictor);
+		free(frameDefs_[i].encoding);
+		free(frameDefs_[i].ops);
+	}
+
+	memset(frameDefs_, 0, sizeof(frameDefs_));
+}
+
+/**
+ * Make room in the frame definition for at least count fields. The attributes of any fields added start out as zero.
+ */
+static void reserveFields(Parser::flightLogFrameDef_t *frameDef, int count) {
+	const int added = count - frameDef->fieldCapacity;
+
+	if (added <= 0)
+		return;
+
+	frameDef->fieldName = (char**) realloc(frameDef->fieldName, count * sizeof(*frameDef->fieldName));
+	frameDef->fieldSigned = (int*) realloc(frameDef->fieldSigned, count * sizeof(*frameDef->fieldSigned));
+	frameDef->predictor = (int*) realloc(frameDef->predictor, count * sizeof(*frameDef->predictor));
+	frameDef->encoding = (int*) realloc(frameDef->encoding, count * sizeof(*frameDef->encoding));
+
+	memset(frameDef->fieldName + frameDef->fieldCapacity, 0, added * sizeof(*frameDef->fieldName));
+	memset(frameDef->fieldSigned + frameDef->fieldCapacity, 0, added * sizeof(*frameDef->fieldSigned));
+	memset(frameDef->predictor + frameDef->fieldCapacity, 0, added * sizeof(*frameDef->predictor));
+	memset(frameDef->encoding + frameDef->fieldCapacity, 0, added * sizeof(*frameDef->encoding));
 
+	frameDef->fieldCapacity = count;
 }
 
 /**
  * Parse a comma-separated list of field names into the given frame definition. Sets the fieldCount field based on the
- * number of names parsed.
+ * number of names parsed, of which only the first FLIGHT_LOG_MAX_FIELDS are kept.
  */
 static void parseFieldNames(const char *line, Parser::flightLogFrameDef_t *frameDef) {
 	char *start, *end;
 	bool done = false;
+	int count = 1;
+
+	for (const char *c = line; *c; c++)
+		if (*c == ',')
+			count++;
 
 	//Make a copy of the line so we can manage its lifetime (and write to it to null terminate the fields)
+	free(frameDef->namesLine);
 	frameDef->namesLine = strdup(line);
 	frameDef->fieldCount = 0;
 
+	reserveFields(frameDef, count < FLIGHT_LOG_MAX_FIELDS ? count : FLIGHT_LOG_MAX_FIELDS);
+
 	start = frameDef->namesLine;
 
-	while (!done && *start) {
+	while (!done && *start && frameDef->fieldCount < FLIGHT_LOG_MAX_FIELDS) {
 		end = start;
 
 		do {
@@ -154,9 +314,13 @@ static void parseFieldNames(const char *line, Parser::flightLogFrameDef_t *frame
 	}
 }
 
-static void parseCommaSeparatedIntegers(char *line, int *target, int maxCount) {
+/**
+ * Parse up to maxCount comma-separated integers into target, returning how many there were.
+ */
+static int parseCommaSeparatedIntegers(char *line, int *target, int maxCount) {
 	char *start, *end;
 	bool done = false;
+	int count = 0;
 
 	start = line;
 
@@ -174,10 +338,24 @@ static void parseCommaSeparatedIntegers(char *line, int *target, int maxCount) {
 
 		*target = atoi(start);
 		target++;
+		count++;
 		maxCount--;
 
 		start = end + 1;
 	}
+
+	return count;
+}
+
+/**
+ * Set the given attribute of the fields of the frame definition from a comma-separated list of integers.
+ */
+static void parseFieldAttribute(char *line, Parser::flightLogFrameDef_t *frameDef, int **attribute) {
+	int values[FLIGHT_LOG_MAX_FIELDS];
+	const int count = parseCommaSeparatedIntegers(line, values, FLIGHT_LOG_MAX_FIELDS);
+
+	reserveFields(frameDef, count);
+	memcpy(*attribute, values, count * sizeof(*values));
 }
 
 void Parser::identifyMainFields(Parser::flightLogFrameDef_t *frameDef) {
@@ -323,58 +501,193 @@ void Parser::identifyFields(uint8_t frameType, flightLogFrameDef_t *frameDef) {
 	}
 }
 
+/**
+ * The header has been read, get ready to decode the frames from the current stream offset on.
+ */
+void Parser::finishHeader(bool raw) {
+	/* Home coord predictors appear in pairs (lat/lon), but the predictor ID is the same for both. It's easier to
+	 * apply the right predictor during parsing if we rewrite the predictor ID for the second half of the pair here:
+	 */
+	flightLogFrameDef_t *gpsFrameDef = frameDef('G');
+
+	for (int i = 1; i < gpsFrameDef->fieldCount; i++) {
+		if (gpsFrameDef->predictor[i - 1] == FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD && gpsFrameDef->predictor[i] == FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD) {
+			gpsFrameDef->predictor[i] = FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD_1;
+		}
+	}
+
+	for (int i = 0; i < (int) ARRAY_LENGTH(frameDefs_); i++)
+		compileFrameDef(&frameDefs_[i], raw);
+
+	parserState_ = PARSER_STATE_DATA;
+	lastFrameType_ = NULL;
+	frameStart_ = pis_.streamOffset();
+}
+
+bool Parser::saveHeaderSnapshot(const char *path) const {
+	const size_t tempPathLength = strlen(path) + sizeof(".tmp");
+	char *tempPath = (char*) malloc(tempPathLength);
+	const char *line = headerText_, *lineEnd;
+	bool written;
+	FILE *file;
+
+	if (headerTextLength_ == 0) {
+		free(tempPath);
+		return false;
+	}
+
+	snprintf(tempPath, tempPathLength, "%s.tmp", path);
+
+	file = fopen(tempPath, "w");
+
+	if (!file) {
+		free(tempPath);
+		return false;
+	}
+
+	// The lines as they appeared in the log, so the snapshot reads like the header it came from
+	fprintf(file, HEADER_SNAPSHOT_MAGIC " %016" PRIx64 "\n", headerHash_);
+
+	for (; line < headerText_ + headerTextLength_; line = lineEnd + 1) {
+		lineEnd = (const char*) memchr(line, '\n', headerText_ + headerTextLength_ - line);
+		fprintf(file, "H %.*s\n", (int) (lineEnd - line), line);
+	}
+
+	written = !ferror(file);
+	written = fclose(file) == 0 && written;
+
+	if (written)
+		written = rename(tempPath, path) == 0;
+	else
+		remove(tempPath);
+
+	free(tempPath);
+
+	return written;
+}
+
+bool Parser::loadHeaderSnapshot(const char *path, bool raw) {
+	char line[1024 + 3];
+	uint64_t hash;
+	bool complete = true;
+	FILE *file = fopen(path, "r");
+
+	if (!file)
+		return false;
+
+	if (!fgets(line, sizeof(line), file) || sscanf(line, HEADER_SNAPSHOT_MAGIC " %" SCNx64, &hash) != 1) {
+		fclose(file);
+		return false;
+	}
+
+	resetLog();
+
+	while (fgets(line, sizeof(line), file)) {
+		int lineLength = strlen(line);
+
+		if (lineLength < 3 || line[lineLength - 1] != '\n' || line[0] != 'H' || line[1] != ' ') {
+			complete = false;
+			break;
+		}
+
+		applyHeaderLine(line + 2, lineLength - 3);
+	}
+
+	fclose(file);
+
+	// A snapshot cut short, edited or of a header without main frames is no use
+	if (!complete || headerHash_ != hash || frameDef('I')->fieldCount == 0) {
+		resetLog();
+		return false;
+	}
+
+	finishHeader(raw);
+
+	// Frames are picked up wherever the stream happens to be, as after a gap
+	mainReferencePending_ = true;
+	startResync(pis_.streamOffset());
+
+	return true;
+}
+
 void Parser::parseHeaderLine() {
-	char *fieldName, *fieldValue;
-	const char *lineStart, *lineEnd, *separatorPos;
+	int lineLength;
 	int i, c;
 	char valueBuffer[1024];
-	union {
-		float f;
-		uint32_t u;
-	} floatConvert;
 
-	if (pis_.inputPeek() != ' ') {
+	if (pis_.streamPeekChar() != ' ') {
 		return;
 	}
 
 	//Skip the space
-	pis_.inputTake();
+	pis_.streamReadChar();
 
-	lineStart = stream->pos;
-	separatorPos = 0;
+	lineLength = 0;
 
 	for (i = 0; i < 1024; i++) {
 		c = pis_.streamReadChar();
 
-		if (c == ':' && !separatorPos) {
-			separatorPos = stream->pos - 1;
-		}
-
 		if (c == '\n')
 			break;
 
 		if (c == EOF || c == '\0')
 			// Line ended before we saw a newline or it has binary stuff in there that shouldn't be there
 			return;
+
+		valueBuffer[lineLength++] = c;
 	}
 
-	if (!separatorPos)
+	if (i == 1024)
 		return;
 
-	lineEnd = stream->pos;
+	applyHeaderLine(valueBuffer, lineLength);
+}
 
-	//Make a duplicate copy of the line so we can null-terminate the two parts
-	memcpy(valueBuffer, lineStart, lineEnd - lineStart);
+/**
+ * Take in the "name:value" header line in the first lineLength chars of line, which has room for one more. The line is
+ * split in place, and kept for saveHeaderSnapshot().
+ */
+void Parser::applyHeaderLine(char *line, int lineLength) {
+	char *fieldName, *fieldValue, *separator;
+	union {
+		float f;
+		uint32_t u;
+	} floatConvert;
+
+	separator = (char*) memchr(line, ':', lineLength);
 
-	fieldName = valueBuffer;
-	valueBuffer[separatorPos - lineStart] = '\0';
+	if (!separator)
+		return;
+
+	if (headerTextLength_ + lineLength + 1 > headerTextCapacity_) {
+		headerTextCapacity_ = (headerTextLength_ + lineLength + 1) * 2;
+		headerText_ = (char*) realloc(headerText_, headerTextCapacity_);
+	}
 
-	fieldValue = valueBuffer + (separatorPos - lineStart) + 1;
-	valueBuffer[lineEnd - lineStart - 1] = '\0';
+	memcpy(headerText_ + headerTextLength_, line, lineLength);
+	headerTextLength_ += lineLength;
+	headerText_[headerTextLength_++] = '\n';
+
+	for (int i = 0; i < lineLength; i++)
+		headerHash_ = (headerHash_ ^ (uint8_t) line[i]) * FNV1A_64_PRIME;
+	headerHash_ = (headerHash_ ^ (uint8_t) '\n') * FNV1A_64_PRIME;
+
+	//Null-terminate the two parts of the line
+	fieldName = line;
+	*separator = '\0';
+
+	fieldValue = separator + 1;
+	line[lineLength] = '\0';
 
 	if (startsWith(fieldName, "Field ")) {
 		uint8_t frameType = (uint8_t) fieldName[strlen("Field ")];
-		flightLogFrameDef_t *frameDef = &frameDefs_[frameType];
+
+		// Definitions of frames we can't decode anyway aren't kept
+		if (!getFrameType(frameType))
+			return;
+
+		flightLogFrameDef_t *frameDef = this->frameDef(frameType);
+		flightLogFrameDef_t *interframeDef = this->frameDef('P');
 
 		if (endsWith(fieldName, " name")) {
 			parseFieldNames(fieldValue, frameDef);
@@ -382,19 +695,21 @@ void Parser::parseHeaderLine() {
 
 			if (frameType == 'I') {
 				// P frames are derived from I frames so copy common data over to the P frame:
-				memcpy(frameDefs_['P'].fieldName, frameDef->fieldName, sizeof(frameDef->fieldName));
-				frameDefs_['P'].fieldCount = frameDef->fieldCount;
+				reserveFields(interframeDef, frameDef->fieldCount);
+				memcpy(interframeDef->fieldName, frameDef->fieldName, frameDef->fieldCount * sizeof(*frameDef->fieldName));
+				interframeDef->fieldCount = frameDef->fieldCount;
 			}
 		} else if (endsWith(fieldName, " signed")) {
-			parseCommaSeparatedIntegers(fieldValue, frameDef->fieldSigned, FLIGHT_LOG_MAX_FIELDS);
+			parseFieldAttribute(fieldValue, frameDef, &frameDef->fieldSigned);
 
 			if (frameType == 'I') {
-				memcpy(frameDefs_['P'].fieldSigned, frameDef->fieldSigned, sizeof(frameDef->fieldSigned));
+				reserveFields(interframeDef, frameDef->fieldCapacity);
+				memcpy(interframeDef->fieldSigned, frameDef->fieldSigned, frameDef->fieldCapacity * sizeof(*frameDef->fieldSigned));
 			}
 		} else if (endsWith(fieldName, " predictor")) {
-			parseCommaSeparatedIntegers(fieldValue, frameDef->predictor, FLIGHT_LOG_MAX_FIELDS);
+			parseFieldAttribute(fieldValue, frameDef, &frameDef->predictor);
 		} else if (endsWith(fieldName, " encoding")) {
-			parseCommaSeparatedIntegers(fieldValue, frameDef->encoding, FLIGHT_LOG_MAX_FIELDS);
+			parseFieldAttribute(fieldValue, frameDef, &frameDef->encoding);
 		}
 	} else if (strcmp(fieldName, "I interval") == 0) {
 		frameIntervalI_ = atoi(fieldValue);
@@ -409,6 +724,7 @@ void Parser::parseHeaderLine() {
 		}
 	} else if (strcmp(fieldName, "Data version") == 0) {
 		dataVersion_ = atoi(fieldValue);
+		readTag8_4S16_ = dataVersion_ < 2 ? streamReadTag8_4S16_v1 : streamReadTag8_4S16_v2;
 	} else if (strcmp(fieldName, "Firmware type") == 0) {
 		if (strcmp(fieldValue, "Cleanflight") == 0)
 			sysConfig_.firmwareType = FIRMWARE_TYPE_CLEANFLIGHT;
@@ -458,201 +774,326 @@ void Parser::parseHeaderLine() {
 /**
  * Should a frame with the given index exist in this log (based on the user's selection of sampling rates)?
  */
-static int shouldHaveFrame(Parser &parser, int32_t frameIndex) {
+int Parser::shouldHaveFrame(Parser &parser, int32_t frameIndex) {
 	return (frameIndex % parser.frameIntervalI_ + parser.frameIntervalPNum_ - 1) % parser.frameIntervalPDenom_ < parser.frameIntervalPNum_;
 }
 
 /**
- * Take the raw value for a a field, apply the prediction that is configured for it, and return it.
+ * Apply the prediction of the op to its fields of the frame being decoded. Predictions from the previous frames are
+ * skipped while there are none, as for the first frame after a stream (re)start. A prediction the header gives no way
+ * to make sets decodeError_ instead.
  */
-static int32_t applyPrediction(Parser &parser, int fieldIndex, int fieldSigned, int predictor, uint32_t value, int32_t *current, int32_t *previous, int32_t *previous2) {
+void Parser::applyPredictions(Parser &parser, const flightLogFrameOp_t *op, int32_t *current, const int32_t *previous, const int32_t *previous2) {
+	int32_t *fields = current + op->first;
+	const int count = op->count;
 
-// First see if we have a prediction that doesn't require a previous frame as reference:
-	switch (predictor) {
+	switch (op->predictor) {
 	case FLIGHT_LOG_FIELD_PREDICTOR_0:
 		// No correction to apply
 		break;
 	case FLIGHT_LOG_FIELD_PREDICTOR_MINTHROTTLE:
-		value += parser.sysConfig_.minthrottle;
+		predictFromOffset(fields, parser.sysConfig_.minthrottle, count);
 		break;
 	case FLIGHT_LOG_FIELD_PREDICTOR_1500:
-		value += 1500;
+		predictFromOffset(fields, 1500, count);
 		break;
 	case FLIGHT_LOG_FIELD_PREDICTOR_MOTOR_0:
-		if (parser.mainFieldIndexes_.motor[0] < 0) {
-			fprintf(stderr, "Attempted to base prediction on motor[0] without that field being defined\n");
-			exit(-1);
+		if (op->reference < 0) {
+			parser.decodeError_ = DECODE_ERROR_NO_MOTOR_0;
+			break;
 		}
-		value += (uint32_t) current[parser.mainFieldIndexes_.motor[0]];
+		predictFromOffset(fields, (uint32_t) current[op->reference], count);
 		break;
 	case FLIGHT_LOG_FIELD_PREDICTOR_VBATREF:
-		value += parser.sysConfig_.vbatref;
+		predictFromOffset(fields, parser.sysConfig_.vbatref, count);
 		break;
 	case FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS:
-		if (!previous)
-			break;
-
-		value += (uint32_t) previous[fieldIndex];
+		if (previous)
+			predictFromHistory<FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS, false>(fields, previous + op->first, NULL, count);
 		break;
 	case FLIGHT_LOG_FIELD_PREDICTOR_STRAIGHT_LINE:
-		if (!previous)
-			break;
-
-		value += 2 * (uint32_t) previous[fieldIndex] - (uint32_t) previous2[fieldIndex];
+		if (previous && previous2)
+			predictFromHistory<FLIGHT_LOG_FIELD_PREDICTOR_STRAIGHT_LINE, false>(fields, previous + op->first, previous2 + op->first, count);
 		break;
 	case FLIGHT_LOG_FIELD_PREDICTOR_AVERAGE_2:
-		if (!previous)
+		if (!previous || !previous2)
 			break;
 
-		if (fieldSigned)
-			value += (uint32_t) ((int32_t) ((uint32_t) previous[fieldIndex] + (uint32_t) previous2[fieldIndex]) / 2);
+		if (op->fieldSigned)
+			predictFromHistory<FLIGHT_LOG_FIELD_PREDICTOR_AVERAGE_2, true>(fields, previous + op->first, previous2 + op->first, count);
 		else
-			value += ((uint32_t) previous[fieldIndex] + (uint32_t) previous2[fieldIndex]) / 2;
+			predictFromHistory<FLIGHT_LOG_FIELD_PREDICTOR_AVERAGE_2, false>(fields, previous + op->first, previous2 + op->first, count);
 		break;
 	case FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD:
-		if (parser.gpsHomeFieldIndexes_.GPS_home[0] < 0) {
-			fprintf(stderr, "Attempted to base prediction on GPS home position without GPS home frame definition\n");
-			exit(-1);
-		}
-
-		value += parser.gpsHomeHistory_[1][parser.gpsHomeFieldIndexes_.GPS_home[0]];
-		break;
 	case FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD_1:
-		if (parser.gpsHomeFieldIndexes_.GPS_home[1] < 1) {
-			fprintf(stderr, "Attempted to base prediction on GPS home position without GPS home frame definition\n");
-			exit(-1);
+		if (op->reference < 0) {
+			parser.decodeError_ = DECODE_ERROR_NO_GPS_HOME;
+			break;
 		}
 
-		value += parser.gpsHomeHistory_[1][parser.gpsHomeFieldIndexes_.GPS_home[1]];
+		predictFromOffset(fields, parser.gpsHomeHistory_[1][op->reference], count);
 		break;
 	case FLIGHT_LOG_FIELD_PREDICTOR_LAST_MAIN_FRAME_TIME:
 		if (parser.mainHistory_[1])
-			value += parser.mainHistory_[1][FLIGHT_LOG_FIELD_INDEX_TIME];
+			predictFromOffset(fields, parser.mainHistory_[1][FLIGHT_LOG_FIELD_INDEX_TIME], count);
 		break;
 	default:
-		fprintf(stderr, "Unsupported field predictor %d\n", predictor);
-		exit(-1);
+		parser.decodeError_ = DECODE_ERROR_UNSUPPORTED_PREDICTOR;
 	}
+}
 
-	return (int32_t) value;
+/**
+ * Encoding or predictor ID as stored in a flightLogFrameOp_t. Anything a corrupt header puts outside the range of a
+ * short becomes -1, which is still reported as unsupported when a frame is decoded.
+ */
+static int16_t frameOpId(int id) {
+	return id >= INT16_MIN && id <= INT16_MAX ? id : -1;
 }
 
 /**
- * Attempt to parse the frame of the given `frameType` into the supplied `frame` buffer using the encoding/predictor
- * definitions from log->frameDefs[`frameType`].
- *
- * raw - Set to true to disable predictions (and so store raw values)
- * skippedFrames - Set to the number of field iterations that were skipped over by rate settings since the last frame.
+ * Compile the field definitions of a frame type into the list of steps parseFrame() runs for each frame: runs of fields
+ * that share an encoding, predictor and signedness become a single step, tagged groups are sized once here rather than
+ * for every frame, and raw mode is baked in by leaving the predictions out.
  */
-static void parseFrame(Parser &parser, uint8_t frameType, int32_t *frame, int32_t *previous, int32_t *previous2, int skippedFrames, bool raw) {
-	Parser::flightLogFrameDef_t *frameDef = parser.frameDefs_[frameType];
+void Parser::compileFrameDef(flightLogFrameDef_t *frameDef, bool raw) {
+	int i = 0;
 
-	int *predictor = frameDef->predictor;
-	int *encoding = frameDef->encoding;
-	int *fieldSigned = frameDef->fieldSigned;
+	// Every step starts at a different field, and a tag group at the end of the frame runs at most 3 fields past it
+	const int maxOps = frameDef->fieldCount + 3 < FLIGHT_LOG_MAX_FIELDS ? frameDef->fieldCount + 3 : FLIGHT_LOG_MAX_FIELDS;
 
-	int i, j, groupCount;
+	frameDef->ops = (flightLogFrameOp_t*) realloc(frameDef->ops, maxOps * sizeof(*frameDef->ops));
+	frameDef->opCount = 0;
 
-	i = 0;
 	while (i < frameDef->fieldCount) {
-		uint32_t value;
-		uint32_t values[8];
+		flightLogFrameOp_t *last = frameDef->opCount > 0 ? &frameDef->ops[frameDef->opCount - 1] : NULL;
+		flightLogFrameOp_t *op;
+		int groupCount, j;
+
+		if (frameDef->predictor[i] == FLIGHT_LOG_FIELD_PREDICTOR_INC) {
+			// Counters predicted from the previous frame with nothing read, even in raw mode
+			if (last && last->kind == FRAME_OP_INCREMENT && last->first + last->count == i) {
+				last->count++;
+			} else {
+				op = &frameDef->ops[frameDef->opCount++];
+
+				op->kind = FRAME_OP_INCREMENT;
+				op->first = i;
+				op->readCount = 0;
+				op->count = 1;
+				op->encoding = FLIGHT_LOG_FIELD_ENCODING_NULL;
+				op->predictor = FLIGHT_LOG_FIELD_PREDICTOR_INC;
+				op->fieldSigned = frameDef->fieldSigned[i] != 0;
+			}
 
-		if (predictor[i] == FLIGHT_LOG_FIELD_PREDICTOR_INC) {
-			frame[i] = skippedFrames + 1;
+			i++;
+			continue;
+		}
 
-			if (previous)
-				frame[i] += previous[i];
+		switch (frameDef->encoding[i]) {
+		case FLIGHT_LOG_FIELD_ENCODING_TAG8_4S16:
+			groupCount = 4;
+			break;
+		case FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32:
+			groupCount = 3;
+			break;
+		case FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB:
+			//How many fields are in this encoded group? Check the subsequent field encodings:
+			for (j = i + 1; j < i + 8 && j < frameDef->fieldCount; j++)
+				if (frameDef->encoding[j] != FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB)
+					break;
 
+			groupCount = j - i;
+			break;
+		default:
+			groupCount = 0;
+		}
+
+		const int predictor = frameOpId(raw ? FLIGHT_LOG_FIELD_PREDICTOR_0 : frameDef->predictor[i]);
+
+		// Another field of the same kind as the previous single field step joins it
+		if (groupCount == 0 && last && last->kind == FRAME_OP_READ && last->encoding == frameOpId(frameDef->encoding[i]) && last->predictor == predictor
+				&& last->fieldSigned == (frameDef->fieldSigned[i] != 0) && last->first + last->readCount == i && last->count == last->readCount) {
+			last->readCount++;
+			last->count++;
 			i++;
-		} else {
-			switch (encoding[i]) {
+			continue;
+		}
+
+		op = &frameDef->ops[frameDef->opCount++];
+
+		op->kind = FRAME_OP_READ;
+		op->first = i;
+		op->readCount = groupCount ? groupCount : 1;
+		op->encoding = frameOpId(frameDef->encoding[i]);
+
+		// A group can't store fields beyond the end of the frame, but all of its values are still read
+		if (op->first + op->readCount > FLIGHT_LOG_MAX_FIELDS)
+			op->readCount = FLIGHT_LOG_MAX_FIELDS - op->first;
+
+		const int groupEnd = i + op->readCount;
+
+		// The group's fields may have different predictors, every change of predictor takes another step
+		for (j = i; j < groupEnd; j++) {
+			// Fields past those defined are decoded with no prediction
+			const bool defined = j < frameDef->fieldCapacity;
+			const int fieldPredictor = frameOpId(raw || !defined ? FLIGHT_LOG_FIELD_PREDICTOR_0 : frameDef->predictor[j]);
+			const bool fieldSigned = defined && frameDef->fieldSigned[j] != 0;
+
+			if (j > i && (fieldPredictor != op->predictor || fieldSigned != op->fieldSigned)) {
+				op = &frameDef->ops[frameDef->opCount++];
+
+				op->kind = FRAME_OP_PREDICT;
+				op->first = j;
+				op->readCount = 0;
+				op->encoding = FLIGHT_LOG_FIELD_ENCODING_NULL;
+			}
+
+			if (op->first == j) {
+				op->count = 1;
+				op->predictor = fieldPredictor;
+				op->fieldSigned = fieldSigned;
+			} else {
+				op->count++;
+			}
+		}
+
+		i = j;
+	}
+
+	// Look up the fields the predictors refer to once, rather than for every frame
+	for (i = 0; i < frameDef->opCount; i++) {
+		flightLogFrameOp_t *op = &frameDef->ops[i];
+
+		switch (op->predictor) {
+		case FLIGHT_LOG_FIELD_PREDICTOR_MOTOR_0:
+			op->reference = mainFieldIndexes_.motor[0];
+			break;
+		case FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD:
+			op->reference = gpsHomeFieldIndexes_.GPS_home[0];
+			break;
+		case FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD_1:
+			op->reference = gpsHomeFieldIndexes_.GPS_home[1] >= 1 ? gpsHomeFieldIndexes_.GPS_home[1] : -1;
+			break;
+		default:
+			op->reference = -1;
+		}
+	}
+}
+
+/**
+ * Attempt to parse the frame of the given `frameType` into the supplied `frame` buffer using the decoding steps
+ * compiled from log->frameDefs[`frameType`].
+ *
+ * skippedFrames - Set to the number of field iterations that were skipped over by rate settings since the last frame.
+ *
+ * A field the definitions give no way to decode sets decodeError_, and the rest of the frame is still read.
+ */
+void Parser::parseFrame(Parser &parser, uint8_t frameType, int32_t *frame, int32_t *previous, int32_t *previous2, int skippedFrames) {
+	const Parser::flightLogFrameDef_t *frameDef = parser.frameDef(frameType);
+	const flightLogFrameOp_t *op = frameDef->ops;
+	const flightLogFrameOp_t *end = op + frameDef->opCount;
+
+	ParserInputStream &pis = parser.pis_;
+	// Whole tag groups are decoded straight into the frame, this only takes one cut short by the end of it
+	int32_t values[8];
+	int i;
+
+	for (; op < end; op++) {
+		int32_t *fields = frame + op->first;
+
+		switch (op->kind) {
+		case FRAME_OP_INCREMENT:
+			for (i = 0; i < op->count; i++)
+				fields[i] = skippedFrames + 1 + (previous ? previous[op->first + i] : 0);
+
+			continue;
+		case FRAME_OP_PREDICT:
+			break;
+		case FRAME_OP_READ:
+			switch (op->encoding) {
 			case FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB:
-				parser.pis_.streamByteAlign ();
+				pis.streamByteAlign();
 
-				value = (uint32_t) parser.pis_.streamReadSignedVB();
+				for (i = 0; i < op->readCount; i++)
+					fields[i] = pis.streamReadSignedVB();
 				break;
 			case FLIGHT_LOG_FIELD_ENCODING_UNSIGNED_VB:
-				parser.pis_.streamByteAlign();
+				pis.streamByteAlign();
 
-				value = parser.pis_.streamReadUnsignedVB();
+				for (i = 0; i < op->readCount; i++)
+					fields[i] = (int32_t) pis.streamReadUnsignedVB();
 				break;
 			case FLIGHT_LOG_FIELD_ENCODING_NEG_14BIT:
-				parser.pis_.streamByteAlign();
+				pis.streamByteAlign();
 
-				value = (uint32_t) -signExtend14Bit(parser.pis_.streamReadUnsignedVB());
+				for (i = 0; i < op->readCount; i++)
+					fields[i] = -signExtend14Bit(pis.streamReadUnsignedVB());
 				break;
 			case FLIGHT_LOG_FIELD_ENCODING_TAG8_4S16:
-				parser.pis_.streamByteAlign();
-
-				if (parser.dataVersion_ < 2)
-					streamReadTag8_4S16_v1(parser.pis_, (int32_t*) values);
-				else
-					streamReadTag8_4S16_v2(parser.pis_, (int32_t*) values);
+				pis.streamByteAlign();
 
-				//Apply the predictors for the fields:
-				for (j = 0; j < 4; j++, i++)
-					frame[i] = applyPrediction(parser, i, fieldSigned[i], raw ? FLIGHT_LOG_FIELD_PREDICTOR_0 : predictor[i], values[j], frame, previous, previous2);
-
-				continue;
+				if (op->readCount == 4) {
+					parser.readTag8_4S16_(pis, fields);
+				} else {
+					parser.readTag8_4S16_(pis, values);
+					memcpy(fields, values, op->readCount * sizeof(*fields));
+				}
 				break;
 			case FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32:
-				parser.pis_.streamByteAlign();
-
-				streamReadTag2_3S32(parser.pis_, (int32_t*) values);
+				pis.streamByteAlign();
 
-				//Apply the predictors for the fields:
-				for (j = 0; j < 3; j++, i++)
-					frame[i] = applyPrediction(parser, i, fieldSigned[i], raw ? FLIGHT_LOG_FIELD_PREDICTOR_0 : predictor[i], values[j], frame, previous, previous2);
-
-				continue;
+				if (op->readCount == 3) {
+					streamReadTag2_3S32(pis, fields);
+				} else {
+					streamReadTag2_3S32(pis, values);
+					memcpy(fields, values, op->readCount * sizeof(*fields));
+				}
 				break;
 			case FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB:
-				parser.pis_.streamByteAlign();
-
-				//How many fields are in this encoded group? Check the subsequent field encodings:
-				for (j = i + 1; j < i + 8 && j < frameDef->fieldCount; j++)
-					if (encoding[j] != FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB)
-						break;
+				pis.streamByteAlign();
 
-				groupCount = j - i;
-
-				streamReadTag8_8SVB(parser.pis_, (int32_t*) values, groupCount);
-
-				for (j = 0; j < groupCount; j++, i++)
-					frame[i] = applyPrediction(parser, i, fieldSigned[i], raw ? FLIGHT_LOG_FIELD_PREDICTOR_0 : predictor[i], values[j], frame, previous, previous2);
-
-				continue;
+				// The decoder stores all 8 values whatever the group's size
+				if (op->readCount == 8) {
+					streamReadTag8_8SVB(pis, fields, 8);
+				} else {
+					streamReadTag8_8SVB(pis, values, op->readCount);
+					memcpy(fields, values, op->readCount * sizeof(*fields));
+				}
 				break;
+			/*
+			 * Reading these bitvalues may cause the stream's bit pointer to no longer lie on a byte boundary, so be sure to call
+			 * streamByteAlign() if you want to read a byte from the stream later.
+			 */
 			case FLIGHT_LOG_FIELD_ENCODING_ELIAS_DELTA_U32:
-				value = streamReadEliasDeltaU32(parser.pis_);
-
-				/*
-				 * Reading this bitvalue may cause the stream's bit pointer to no longer lie on a byte boundary, so be sure to call
-				 * streamByteAlign() if you want to read a byte from the stream later.
-				 */
+				for (i = 0; i < op->readCount; i++)
+					fields[i] = (int32_t) streamReadEliasDeltaU32(pis);
 				break;
 			case FLIGHT_LOG_FIELD_ENCODING_ELIAS_DELTA_S32:
-				value = streamReadEliasDeltaS32(parser.pis_);
+				for (i = 0; i < op->readCount; i++)
+					fields[i] = streamReadEliasDeltaS32(pis);
 				break;
 			case FLIGHT_LOG_FIELD_ENCODING_ELIAS_GAMMA_U32:
-				value = streamReadEliasGammaU32(parser.pis_);
+				for (i = 0; i < op->readCount; i++)
+					fields[i] = (int32_t) streamReadEliasGammaU32(pis);
 				break;
 			case FLIGHT_LOG_FIELD_ENCODING_ELIAS_GAMMA_S32:
-				value = streamReadEliasGammaS32(parser.pis_);
+				for (i = 0; i < op->readCount; i++)
+					fields[i] = streamReadEliasGammaS32(pis);
 				break;
 			case FLIGHT_LOG_FIELD_ENCODING_NULL:
 				//Nothing to read
-				value = 0;
+				memset(fields, 0, op->readCount * sizeof(*fields));
 				break;
 			default:
-				fprintf(stderr, "Unsupported field encoding %d\n", encoding[i]);
-				exit(-1);
+				// Nothing is known to read, the frame will be rejected once it ends
+				memset(fields, 0, op->readCount * sizeof(*fields));
+				parser.decodeError_ = DECODE_ERROR_UNSUPPORTED_ENCODING;
 			}
-
-			frame[i] = applyPrediction(parser, i, fieldSigned[i], raw ? FLIGHT_LOG_FIELD_PREDICTOR_0 : predictor[i], value, frame, previous, previous2);
-			i++;
+			break;
 		}
+
+		if (op->predictor != FLIGHT_LOG_FIELD_PREDICTOR_0)
+			applyPredictions(parser, op, frame, previous, previous2);
 	}
 
 	parser.pis_.streamByteAlign();
@@ -662,7 +1103,7 @@ static void parseFrame(Parser &parser, uint8_t frameType, int32_t *frame, int32_
  * Based on the log sampling rate, work out how many frames would have been skipped after the last frame that was
  * parsed until we get to the next logged iteration.
  */
-static uint32_t countIntentionallySkippedFrames(Parser &parser) {
+uint32_t Parser::countIntentionallySkippedFrames(Parser &parser) {
 	uint32_t count = 0, frameIndex;
 
 	if (parser.lastMainFrameIteration_ == (uint32_t) -1) {
@@ -681,7 +1122,7 @@ static uint32_t countIntentionallySkippedFrames(Parser &parser) {
  * Based on the log sampling rate, work out how many frames would have been skipped after the last frame that was
  * parsed until we get to the iteration with the given index.
  */
-static uint32_t countIntentionallySkippedFramesTo(Parser &parser, uint32_t targetIteration) {
+uint32_t Parser::countIntentionallySkippedFramesTo(Parser &parser, uint32_t targetIteration) {
 	uint32_t count = 0, frameIndex;
 
 	if (parser.lastMainFrameIteration_ == (uint32_t) -1) {
@@ -701,35 +1142,41 @@ static uint32_t countIntentionallySkippedFramesTo(Parser &parser, uint32_t targe
 /**
  * Attempt to parse the Intraframe at the current log position into the history buffer at blackboxHistoryRing_[0].
  */
-static void parseIntraframe(Parser &parser, bool raw) {
+void Parser::parseIntraframe(Parser &parser, bool raw) {
 	int32_t *current = parser.mainHistory_[0];
 	int32_t *previous = parser.mainHistory_[1];
-	parseFrame(parser, 'I', current, previous, NULL, 0, raw);
+	(void) raw;
+
+	parseFrame(parser, 'I', current, previous, NULL, 0);
 }
 
 /**
  * Attempt to parse the interframe at the current log position into the history buffer at mainHistory[0].
  */
-static void parseInterframe(Parser &parser, bool raw) {
+void Parser::parseInterframe(Parser &parser, bool raw) {
 	int32_t *current = parser.mainHistory_[0];
 	int32_t *previous = parser.mainHistory_[1];
 	int32_t *previous2 = parser.mainHistory_[2];
+	(void) raw;
 
 	parser.lastSkippedFrames_ = countIntentionallySkippedFrames(parser);
 
-	parseFrame(parser, 'P', current, previous, previous2, parser.lastSkippedFrames_, raw);
+	parseFrame(parser, 'P', current, previous, previous2, parser.lastSkippedFrames_);
 }
 
-static void parseGPSFrame(Parser &parser, bool raw) {
-	parseFrame(parser, 'G', parser.lastGPS_, NULL, NULL, 0, raw);
+void Parser::parseGPSFrame(Parser &parser, bool raw) {
+	(void) raw;
+	parseFrame(parser, 'G', parser.lastGPS_, NULL, NULL, 0);
 }
 
-static void parseGPSHomeFrame(Parser &parser, bool raw) {
-	parseFrame(parser, 'H', parser.gpsHomeHistory_[0], NULL, NULL, 0, raw);
+void Parser::parseGPSHomeFrame(Parser &parser, bool raw) {
+	(void) raw;
+	parseFrame(parser, 'H', parser.gpsHomeHistory_[0], NULL, NULL, 0);
 }
 
-static void parseSlowFrame(Parser &parser, bool raw) {
-	parseFrame(parser, 'S', parser.lastSlow_, NULL, NULL, 0, raw);
+void Parser::parseSlowFrame(Parser &parser, bool raw) {
+	(void) raw;
+	parseFrame(parser, 'S', parser.lastSlow_, NULL, NULL, 0);
 }
 
 /**
@@ -737,7 +1184,7 @@ static void parseSlowFrame(Parser &parser, bool raw) {
  * Return false if the event couldn't be parsed (e.g. unknown event ID), or true if it might have been
  * parsed successfully.
  */
-static void parseEventFrame(Parser &parser, bool raw) {
+void Parser::parseEventFrame(Parser &parser, bool raw) {
 	static const char END_OF_LOG_MESSAGE[] = "End of log\0";
 	enum {
 		END_OF_LOG_MESSAGE_LEN = 11
@@ -748,7 +1195,7 @@ static void parseEventFrame(Parser &parser, bool raw) {
 	uint8_t eventType = parser.pis_.streamReadByte();
 
 	flightLogEventData_t *data = &parser.lastEvent_.data;
-	parser.lastEvent_.event = eventType;
+	parser.lastEvent_.event = (FlightLogEvent) eventType;
 
 	switch (eventType) {
 	case FLIGHT_LOG_EVENT_SYNC_BEEP:
@@ -795,49 +1242,54 @@ static void parseEventFrame(Parser &parser, bool raw) {
 		parser.pis_.streamRead(endMessage, END_OF_LOG_MESSAGE_LEN);
 
 		if (strncmp(endMessage, END_OF_LOG_MESSAGE, END_OF_LOG_MESSAGE_LEN) == 0) {
-//Adjust the end of stream so we stop reading, this log is done
-			stream->end = stream->pos;
+			if (parser.feedStream_) {
+				// A live feed carries on with the next log once this one is complete
+				parser.logEnded_ = true;
+			} else {
+				//Adjust the end of stream so we stop reading, this log is done
+				parser.pis_.streamEnd();
+			}
 		} else {
 			/*
 			 * This isn't the real end of log message, it's probably just some bytes that happened to look like
 			 * an event header.
 			 */
-			parser.lastEvent_.event = -1;
+			parser.lastEvent_.event = (FlightLogEvent) -1;
 		}
 		break;
 	default:
-		parser.lastEvent_.event = -1;
+		parser.lastEvent_.event = (FlightLogEvent) -1;
 	}
 }
 
-static void updateMainFieldStatistics(Parser &parser, int32_t *fields) {
-	int i;
-	Parser::flightLogFrameDef_t *frameDef = &parser.frameDefs_['I'];
+/**
+ * Widen the ranges [minKeys[i], maxKeys[i]] to take in the fields of a frame, in blocks of 8 fields which may run past
+ * count (up to FLIGHT_LOG_MAX_FIELDS). With both kinds of field compared alike (see fieldMinKeys_) the compiler turns
+ * each block into a few vector instructions.
+ */
+static void widenFieldRanges(const int32_t *__restrict__ fields, const int32_t *__restrict__ keyBiases, int count, int32_t *__restrict__ minKeys,
+		int32_t *__restrict__ maxKeys) {
+	for (int block = 0; block < count; block += 8) {
+		for (int i = block; i < block + 8; i++) {
+			const int32_t key = fields[i] ^ keyBiases[i];
+
+			minKeys[i] = key < minKeys[i] ? key : minKeys[i];
+			maxKeys[i] = key > maxKeys[i] ? key : maxKeys[i];
+		}
+	}
+}
+
+void Parser::updateMainFieldStatistics(Parser &parser, int32_t *fields) {
+	const Parser::flightLogFrameDef_t *frameDef = parser.frameDef('I');
 
 	if (!parser.stats_.haveFieldStats) {
-		//If this is the first frame, there are no minimums or maximums in the stats to compare with
-		for (i = 0; i < frameDef->fieldCount; i++) {
-			if (frameDef->fieldSigned[i]) {
-				parser.stats_.field[i].max = fields[i];
-				parser.stats_.field[i].min = fields[i];
-			} else {
-				parser.stats_.field[i].max = (uint32_t) fields[i];
-				parser.stats_.field[i].min = (uint32_t) fields[i];
-			}
-		}
+		for (int i = 0; i < FLIGHT_LOG_MAX_FIELDS; i++)
+			parser.fieldKeyBiases_[i] = i < frameDef->fieldCount && frameDef->fieldSigned[i] ? 0 : INT32_MIN;
 
 		parser.stats_.haveFieldStats = true;
-	} else {
-		for (i = 0; i < frameDef->fieldCount; i++) {
-			if (frameDef->fieldSigned[i]) {
-				parser.stats_.field[i].max = fields[i] > parser.stats_.field[i].max ? fields[i] : parser.stats_.field[i].max;
-				parser.stats_.field[i].min = fields[i] < parser.stats_.field[i].min ? fields[i] : parser.stats_.field[i].min;
-			} else {
-				parser.stats_.field[i].max = (uint32_t) fields[i] > parser.stats_.field[i].max ? (uint32_t) fields[i] : parser.stats_.field[i].max;
-				parser.stats_.field[i].min = (uint32_t) fields[i] < parser.stats_.field[i].min ? (uint32_t) fields[i] : parser.stats_.field[i].min;
-			}
-		}
 	}
+
+	widenFieldRanges(fields, parser.fieldKeyBiases_, frameDef->fieldCount, parser.fieldMinKeys_, parser.fieldMaxKeys_);
 }
 
 #define ADCVREF 33L
@@ -879,14 +1331,19 @@ double Parser::flightlogGyroToRadiansPerSecond(int32_t gyroRaw) {
 	return (double) sysConfig_.gyroScale * 1000000 * gyroRaw;
 }
 
-static void flightlogDecodeFlagsToString(uint32_t flags, int numFlags, const char * const *flagNames, char *dest, unsigned destLen) {
+/**
+ * Names of the flags set, separated by '|', or "0" for none. Returns false if dest is too short, it then holds as many
+ * of the names as fit.
+ */
+static bool flightlogDecodeFlagsToString(uint32_t flags, int numFlags, const char * const *flagNames, char *dest, unsigned destLen) {
 	bool printedFlag = false;
 	const char NO_FLAGS_MESSAGE[] = "0";
 
 	// The buffer should at least be large enough for us to add the "no flags present" message in!
 	if (destLen < strlen(NO_FLAGS_MESSAGE) + 1) {
-		fprintf(stderr, "Flag buffer too short\n");
-		exit(-1);
+		if (destLen > 0)
+			*dest = '\0';
+		return false;
 	}
 
 	for (int i = 0; i < numFlags; i++) {
@@ -896,8 +1353,9 @@ static void flightlogDecodeFlagsToString(uint32_t flags, int numFlags, const cha
 
 			if (destLen < (printedFlag ? 1 : 0) + flagNameLen + 1 /* Null-terminator */) {
 // Not enough room in the dest string to fit this flag
-				fprintf(stderr, "Flag buffer too short\n");
-				exit(-1);
+				if (!printedFlag)
+					*dest = '\0';
+				return false;
 			}
 
 			if (printedFlag) {
@@ -918,10 +1376,18 @@ static void flightlogDecodeFlagsToString(uint32_t flags, int numFlags, const cha
 	if (!printedFlag) {
 		strcpy(dest, NO_FLAGS_MESSAGE);
 	}
+
+	return true;
 }
 
+/**
+ * Name of the enum value, or the value itself if it has no name. A name that doesn't fit in dest leaves it empty, a
+ * number is truncated.
+ */
 void flightlogDecodeEnumToString(uint32_t value, unsigned numEnums, const char * const *enumNames, char *dest, unsigned destLen) {
-	assert(destLen > 1);
+	// No room even for the terminator
+	if (destLen == 0)
+		return;
 
 	if (value < numEnums) {
 		const char *name = enumNames[value];
@@ -938,34 +1404,47 @@ void flightlogDecodeEnumToString(uint32_t value, unsigned numEnums, const char *
 	}
 }
 
-void Parser::flightlogFlightModeToString(uint32_t flightMode, char *dest, int destLen) {
-	flightlogDecodeFlagsToString(flightMode, FLIGHT_LOG_FLIGHT_MODE_COUNT, FLIGHT_LOG_FLIGHT_MODE_NAME, dest, destLen);
+bool Parser::flightlogFlightModeToString(uint32_t flightMode, char *dest, int destLen) {
+	return flightlogDecodeFlagsToString(flightMode, FLIGHT_LOG_FLIGHT_MODE_COUNT, FLIGHT_LOG_FLIGHT_MODE_NAME, dest, destLen);
 }
 
-void Parser::flightlogFlightStateToString(uint32_t flightState, char *dest, int destLen) {
-	flightlogDecodeFlagsToString(flightState, FLIGHT_LOG_FLIGHT_STATE_COUNT, FLIGHT_LOG_FLIGHT_STATE_NAME, dest, destLen);
+bool Parser::flightlogFlightStateToString(uint32_t flightState, char *dest, int destLen) {
+	return flightlogDecodeFlagsToString(flightState, FLIGHT_LOG_FLIGHT_STATE_COUNT, FLIGHT_LOG_FLIGHT_STATE_NAME, dest, destLen);
 }
 
 void Parser::flightlogFailsafePhaseToString(uint8_t failsafePhase, char *dest, int destLen) {
 	flightlogDecodeEnumToString(failsafePhase, FLIGHT_LOG_FAILSAFE_PHASE_COUNT, FLIGHT_LOG_FAILSAFE_PHASE_NAME, dest, destLen);
 }
 
-Parser::flightLogFrameType_t* Parser::getFrameType(uint8_t c) {
-	for (int i = 0; i < (int) ARRAY_LENGTH(frameTypes_); i++)
-		if (frameTypes_[i].marker == c)
-			return &frameTypes_[i];
-
-	return 0;
-}
-
-static void flightLoginvalidateStream(Parser &parser) {
+void Parser::flightLoginvalidateStream(Parser &parser) {
 	parser.mainStreamIsValid_ = false;
 	parser.mainHistory_[1] = 0;
 	parser.mainHistory_[2] = 0;
 }
 
-static bool completeIntraframe(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw) {
+void Parser::streamDiscontinuity() {
+	flightLoginvalidateStream(*this);
+
+	if (feedStream_) {
+		// Whatever was fed before the gap can't be completed by what comes after it
+		pis_.streamSkip(pis_.streamAvailable());
+		lastFrameType_ = NULL;
+		lastFrameCommitted_ = false;
+		clockSamplePending_ = false;
+	}
+
+	lastMainFrameIteration_ = (uint32_t) -1;
+	lastMainFrameTime_ = (uint32_t) -1;
+	mainReferencePending_ = true;
+	prematureEof_ = false;
+
+	// Whatever comes next may start anywhere in a frame
+	startResync(pis_.streamOffset());
+}
+
+bool Parser::completeIntraframe(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw) {
 	bool acceptFrame = true;
+	bool candidate;
 
 	// Do we have a previous frame to use as a reference to validate field values against?
 	if (!raw && parser.lastMainFrameIteration_ != (uint32_t) -1) {
@@ -978,23 +1457,40 @@ static bool completeIntraframe(Parser &parser, uint8_t frameType, const char *fr
 				&& (uint32_t) parser.mainHistory_[0][FLIGHT_LOG_FIELD_INDEX_TIME] < parser.lastMainFrameTime_ + MAXIMUM_TIME_JUMP_BETWEEN_FRAMES;
 	}
 
-	if (acceptFrame) {
-		parser.stats_.intentionallyAbsentIterations += countIntentionallySkippedFramesTo(parser, (uint32_t) parser.mainHistory_[0][FLIGHT_LOG_FIELD_INDEX_ITERATION]);
+	/*
+	 * After a gap any byte that happens to be an 'I' may pass for an I-frame, and a bogus one taken as the reference
+	 * would have every real I-frame after it rejected. So the first I-frame is only a candidate, reported as invalid,
+	 * until the next I-frame agrees with it. One that doesn't replaces it. P-frames can't vouch for a candidate, their
+	 * iteration and time are predicted from it, but they are decoded from it all the same.
+	 */
+	candidate = !raw && parser.mainReferencePending_ && (!acceptFrame || parser.lastMainFrameIteration_ == (uint32_t) -1);
+
+	if (candidate) {
+		parser.lastMainFrameIteration_ = (uint32_t) parser.mainHistory_[0][FLIGHT_LOG_FIELD_INDEX_ITERATION];
+		parser.lastMainFrameTime_ = (uint32_t) parser.mainHistory_[0][FLIGHT_LOG_FIELD_INDEX_TIME];
+		parser.mainStreamIsValid_ = false;
+		acceptFrame = false;
+	} else if (acceptFrame) {
+		parser.mainReferencePending_ = false;
+
+		if (parser.statsLevel_ != STATS_OFF)
+			parser.stats_.intentionallyAbsentIterations += countIntentionallySkippedFramesTo(parser,
+					(uint32_t) parser.mainHistory_[0][FLIGHT_LOG_FIELD_INDEX_ITERATION]);
 
 		parser.lastMainFrameIteration_ = (uint32_t) parser.mainHistory_[0][FLIGHT_LOG_FIELD_INDEX_ITERATION];
 		parser.lastMainFrameTime_ = (uint32_t) parser.mainHistory_[0][FLIGHT_LOG_FIELD_INDEX_TIME];
 
 		parser.mainStreamIsValid_ = true;
 
-		updateMainFieldStatistics(parser, parser.mainHistory_[0]);
+		if (parser.statsLevel_ == STATS_FULL)
+			updateMainFieldStatistics(parser, parser.mainHistory_[0]);
 	} else {
 		flightLoginvalidateStream(parser);
 	}
 
-	if (parser.onFrameReady)
-		parser.onFrameReady(parser, parser.mainStreamIsValid_, parser.mainHistory_[0], frameType, parser.frameDefs_[(int) frameType].fieldCount, frameStart - stream->data, frameEnd - frameStart);
+	parser.frameReady(parser.mainStreamIsValid_, parser.mainHistory_[0], frameType, parser.frameDef(frameType)->fieldCount, frameStart, frameEnd);
 
-	if (acceptFrame) {
+	if (acceptFrame || candidate) {
 		// Rotate history buffers
 
 // Both the previous and previous-previous states become the I-frame, because we can't look further into the past than the I-frame
@@ -1010,7 +1506,7 @@ static bool completeIntraframe(Parser &parser, uint8_t frameType, const char *fr
 	return acceptFrame;
 }
 
-static bool completeInterframe(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw) {
+bool Parser::completeInterframe(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw) {
 	(void) frameType;
 	(void) raw;
 
@@ -1025,17 +1521,19 @@ static bool completeInterframe(Parser &parser, uint8_t frameType, const char *fr
 		parser.lastMainFrameIteration_ = (uint32_t) parser.mainHistory_[0][FLIGHT_LOG_FIELD_INDEX_ITERATION];
 		parser.lastMainFrameTime_ = (uint32_t) parser.mainHistory_[0][FLIGHT_LOG_FIELD_INDEX_TIME];
 
-		parser.stats_.intentionallyAbsentIterations += parser.lastSkippedFrames_;
+		if (parser.statsLevel_ != STATS_OFF)
+			parser.stats_.intentionallyAbsentIterations += parser.lastSkippedFrames_;
 
-		updateMainFieldStatistics(parser, parser.mainHistory_[0]);
+		if (parser.statsLevel_ == STATS_FULL)
+			updateMainFieldStatistics(parser, parser.mainHistory_[0]);
 	}
 
 	//Receiving a P frame can't resynchronise the stream so it doesn't set mainStreamIsValid to true
 
-	if (parser.onFrameReady)
-		parser.onFrameReady(log, parser.mainStreamIsValid_, parser.mainHistory_[0], frameType, parser.frameDefs_['I'].fieldCount, frameStart - stream->data, frameEnd - frameStart);
+	parser.frameReady(parser.mainStreamIsValid_, parser.mainHistory_[0], frameType, parser.frameDef('I')->fieldCount, frameStart, frameEnd);
 
-	if (parser.mainStreamIsValid_) {
+	// Still untrusted, but decoded from the candidate I-frame so that the values are right once the next I-frame agrees
+	if (parser.mainStreamIsValid_ || (parser.mainReferencePending_ && parser.lastMainFrameIteration_ != (uint32_t) -1)) {
 		// Rotate history buffers
 		parser.mainHistory_[2] = parser.mainHistory_[1];
 		parser.mainHistory_[1] = parser.mainHistory_[0];
@@ -1049,7 +1547,7 @@ static bool completeInterframe(Parser &parser, uint8_t frameType, const char *fr
 	return parser.mainStreamIsValid_;
 }
 
-static bool completeEventFrame(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw) {
+bool Parser::completeEventFrame(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw) {
 	flightLogEvent_t *lastEvent = &parser.lastEvent_;
 
 	(void) frameType;
@@ -1067,14 +1565,15 @@ static bool completeEventFrame(Parser &parser, uint8_t frameType, const char *fr
 			 */
 			parser.lastMainFrameIteration_ = lastEvent->data.loggingResume.logIteration;
 			parser.lastMainFrameTime_ = lastEvent->data.loggingResume.currentTime;
+
+			// The FC clock kept running through the pause, only the time unwrapping needs to catch up
+			parser.clockSync_.resume(lastEvent->data.loggingResume.currentTime);
 			break;
 		default:
 			;
 		}
 
-		if (parser.onEvent) {
-			parser.onEvent(log, lastEvent);
-		}
+		parser.flightLogEventReady(lastEvent);
 
 		return true;
 	}
@@ -1082,7 +1581,7 @@ static bool completeEventFrame(Parser &parser, uint8_t frameType, const char *fr
 	return false;
 }
 
-static bool completeGPSHomeFrame(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw) {
+bool Parser::completeGPSHomeFrame(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw) {
 	(void) frameType;
 	(void) frameStart;
 	(void) frameEnd;
@@ -1092,150 +1591,468 @@ static bool completeGPSHomeFrame(Parser &parser, uint8_t frameType, const char *
 	memcpy(&parser.gpsHomeHistory_[1], &parser.gpsHomeHistory_[0], sizeof(*parser.gpsHomeHistory_));
 	parser.gpsHomeIsValid_ = true;
 
-	if (parser.onFrameReady) {
-		parser.onFrameReady(parser, true, parser.gpsHomeHistory_[1], frameType, parser.frameDefs_[frameType].fieldCount, frameStart - stream->data, frameEnd - frameStart);
-	}
+	parser.frameReady(true, parser.gpsHomeHistory_[1], frameType, parser.frameDef(frameType)->fieldCount, frameStart, frameEnd);
 
 	return true;
 }
 
-static bool completeGPSFrame(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw) {
+bool Parser::completeGPSFrame(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw) {
 	(void) frameType;
 	(void) frameStart;
 	(void) frameEnd;
 	(void) raw;
 
-	if (parser.onFrameReady) {
-		parser.onFrameReady(log, parser.gpsHomeIsValid_, parser.lastGPS_, frameType, parser.frameDefs_[frameType].fieldCount, frameStart - stream->data, frameEnd - frameStart);
-	}
+	parser.frameReady(parser.gpsHomeIsValid_, parser.lastGPS_, frameType, parser.frameDef(frameType)->fieldCount, frameStart, frameEnd);
 
 	return true;
 }
 
-static bool completeSlowFrame(Parser &parser, uint8_t frameType, const char *frameStart, const char *frameEnd, bool raw) {
+bool Parser::completeSlowFrame(Parser &parser, uint8_t frameType, uint64_t frameStart, uint64_t frameEnd, bool raw) {
 	(void) frameType;
 	(void) frameStart;
 	(void) frameEnd;
 	(void) raw;
 
-	if (parser.onFrameReady) {
-		parser.onFrameReady(log, true, parser.lastSlow_, frameType, parser.frameDefs_[frameType].fieldCount, frameStart - stream->data, frameEnd - frameStart);
-	}
+	parser.frameReady(true, parser.lastSlow_, frameType, parser.frameDef(frameType)->fieldCount, frameStart, frameEnd);
 
 	return true;
 }
 
+void Parser::frameReady(bool frameValid, int32_t *frame, uint8_t frameType, int fieldCount, uint64_t frameStart, uint64_t frameEnd) {
+	uint64_t frameStartTime = pis_.streamArrivalTime(frameStart);
+	uint64_t frameEndTime = frameEnd > frameStart ? pis_.streamArrivalTime(frameEnd - 1) : frameStartTime;
+
+	// The first byte left the FC closest to the moment the frame was stamped, so that's the one to sync on
+	if (frameValid && frame && frameStartTime && (frameType == 'I' || frameType == 'P')) {
+		if (lastFrameCommitted_) {
+			// Passed on early, so it may yet be retracted. Only a confirmed frame gets to teach the clock model.
+			clockSamplePending_ = true;
+			pendingClockSampleTime_ = (uint32_t) frame[FLIGHT_LOG_FIELD_INDEX_TIME];
+			pendingClockSampleUs_ = frameStartTime;
+		} else {
+			clockSync_.add_sample((uint32_t) frame[FLIGHT_LOG_FIELD_INDEX_TIME], frameStartTime);
+		}
+	}
+
+	flightLogFrameReady(frameValid, frame, frameType, fieldCount, frameStart, (int) (frameEnd - frameStart), frameStartTime, frameEndTime);
+}
+
+/**
+ * Pass on the frame of the given type that started at frameStart_ and ends at frameEnd, and count it.
+ */
+void Parser::completeFrame(flightLogFrameType_t *frameType, uint64_t frameEnd, bool raw) {
+	const unsigned int frameSize = frameEnd - frameStart_;
+
+	if (resyncing_)
+		finishResync();
+
+	lastFrameAccepted_ = true;
+
+	if (frameType->complete)
+		lastFrameAccepted_ = frameType->complete(*this, frameType->marker, frameStart_, frameEnd, raw);
+
+	if (statsLevel_ == STATS_OFF)
+		return;
+
+	flightLogFrameStatistics_t *frameStats = &stats_.frame[frameType->marker];
+
+	if (lastFrameAccepted_) {
+		//Update statistics for this frame type
+		frameStats->bytes += frameSize;
+		frameStats->validCount++;
+
+		if (frameStats->sizeCount)
+			frameStats->sizeCount[frameSize]++;
+	} else {
+		frameStats->desyncCount++;
+	}
+}
+
+/**
+ * A frame passed on early turned out not to be followed by another frame after all. Take back its statistics and the
+ * state it was trusted to update, the corruption notice that follows tells the caller to disregard it.
+ */
+void Parser::retractFrame(flightLogFrameType_t *frameType, unsigned int frameSize) {
+	if (statsLevel_ != STATS_OFF) {
+		flightLogFrameStatistics_t *frameStats = &stats_.frame[frameType->marker];
+
+		if (lastFrameAccepted_) {
+			frameStats->bytes -= frameSize;
+			frameStats->validCount--;
+
+			if (frameStats->sizeCount)
+				frameStats->sizeCount[frameSize]--;
+		} else {
+			frameStats->desyncCount--;
+		}
+
+		frameStats->retractedCount++;
+	}
+
+	switch (frameType->marker) {
+	case 'I':
+	case 'P':
+		// Hold the next I-frame to the main frame before this one, as if this one had never been seen
+		lastMainFrameIteration_ = committedMainFrameIteration_;
+		lastMainFrameTime_ = committedMainFrameTime_;
+		mainReferencePending_ = committedMainReferencePending_;
+		clockSamplePending_ = false;
+		break;
+	case 'H':
+		// The old home position was already overwritten
+		gpsHomeIsValid_ = false;
+		break;
+	}
+}
+
+static const char * const DECODE_ERROR_MESSAGE[Parser::DECODE_ERROR_COUNT] = {
+	NULL,
+	"Unsupported field predictor",
+	"Unsupported field encoding",
+	"Attempted to base prediction on motor[0] without that field being defined",
+	"Attempted to base prediction on GPS home position without GPS home frame definition"
+};
+
+/**
+ * The frame just read can't be decoded with the header's field definitions (see decodeError_). Rather than give up on
+ * the log, report it as a corrupt frame and search for the next frame from its second byte on. A main frame also leaves
+ * the main stream to be resynchronised, as for any corrupt frame.
+ */
+void Parser::rejectUndecodableFrame(flightLogFrameType_t *frameType) {
+	if (!(decodeErrorsWarned_ & (1 << decodeError_))) {
+		fprintf(stderr, "%s in '%c' frame, skipping such frames\n", DECODE_ERROR_MESSAGE[decodeError_], frameType->marker);
+		decodeErrorsWarned_ |= 1 << decodeError_;
+	}
+
+	if (statsLevel_ != STATS_OFF) {
+		stats_.frame[frameType->marker].corruptCount++;
+		stats_.totalCorruptFrames++;
+		stats_.decodeErrors[decodeError_]++;
+	}
+
+	if (frameType->marker == 'I' || frameType->marker == 'P')
+		mainStreamIsValid_ = false;
+
+	frameReady(false, 0, frameType->marker, 0, frameStart_, pis_.streamOffset());
+
+	pis_.streamSeek(frameStart_ + 1);
+	lastFrameType_ = NULL;
+	lastFrameCommitted_ = false;
+	prematureEof_ = false;
+	decodeError_ = DECODE_OK;
+
+	startResync(frameStart_ + 1);
+}
+
+/**
+ * Lost track of the frames, search for the next one from the given stream offset on.
+ */
+void Parser::startResync(uint64_t offset) {
+	if (resyncing_)
+		return;
+
+	resyncing_ = true;
+	resyncOffset_ = offset;
+	resyncStartUs_ = monotonic_time_us();
+
+	if (statsLevel_ != STATS_OFF)
+		stats_.resyncCount++;
+}
+
+/**
+ * The search found a frame, starting at frameStart_.
+ */
+void Parser::finishResync() {
+	resyncing_ = false;
+
+	if (statsLevel_ != STATS_OFF) {
+		stats_.resyncBytesSkipped += frameStart_ - resyncOffset_;
+		stats_.resyncTimeUs += monotonic_time_us() - resyncStartUs_;
+	}
+}
+
+/**
+ * Whether the I-frame whose marker was just read could be accepted by completeIntraframe(), judged by its iteration and
+ * time alone so that a hopeless one isn't decoded while resynchronising. Gives it the benefit of the doubt whenever
+ * those two fields can't be read on their own, or not yet.
+ */
+bool Parser::plausibleIntraframe(bool raw) {
+	const flightLogFrameDef_t *frameDef = this->frameDef('I');
+	const flightLogFrameOp_t *op = frameDef->ops;
+
+	// Nothing to judge by, or only a candidate that this I-frame may yet replace
+	if (raw || lastMainFrameIteration_ == (uint32_t) -1 || mainReferencePending_)
+		return true;
+
+	if (frameDef->opCount == 0 || op->kind != FRAME_OP_READ || op->first != FLIGHT_LOG_FIELD_INDEX_ITERATION || op->readCount < 2
+			|| op->encoding != FLIGHT_LOG_FIELD_ENCODING_UNSIGNED_VB || op->predictor != FLIGHT_LOG_FIELD_PREDICTOR_0)
+		return true;
+
+	const uint32_t iteration = pis_.streamReadUnsignedVB();
+	const uint32_t time = pis_.streamReadUnsignedVB();
+	const bool eof = pis_.streamEof();
+
+	// Wherever the chunks of the stream are split, the verdict is the same once both fields have arrived
+	pis_.streamSeek(frameStart_ + 1);
+
+	if (eof)
+		return true;
+
+	return iteration >= lastMainFrameIteration_ && iteration < lastMainFrameIteration_ + MAXIMUM_ITERATION_JUMP_BETWEEN_FRAMES
+			&& time >= lastMainFrameTime_ && time < lastMainFrameTime_ + MAXIMUM_TIME_JUMP_BETWEEN_FRAMES;
+}
+
+/**
+ * Whether the 'H' just read begins a new log's header rather than a GPS home frame. It does when the log start marker
+ * follows it, as when the FC starts a new log without having ended the last one where it could be seen. Returns -1 if
+ * the data fed so far ends before that can be told.
+ */
+int Parser::startsNewLog(bool more) {
+	const char *marker = LOG_START_MARKER + 1;
+	int result = 1;
+
+	for (; *marker; marker++) {
+		int c = pis_.streamReadChar();
+
+		if (c == EOF) {
+			result = more ? -1 : 0;
+			break;
+		}
+
+		if (c != *marker) {
+			result = 0;
+			break;
+		}
+	}
+
+	pis_.streamSeek(frameStart_ + 1);
+
+	return result;
+}
+
 bool Parser::parse(bool raw) {
-	char *frameStart;
-	flightLogFrameType_t *frameType;
-	flightLogFrameType_t *lastFrameType;
+	return parseAvailable(raw, false);
+}
 
-	ParserState parserState = PARSER_STATE_HEADER;
+void Parser::feed(const uint8_t *data, size_t length, uint64_t rxTimeUs, bool raw) {
+	assert(feedSource_);
+
+	feedSource_->push(data, length, rxTimeUs);
+	parseAvailable(raw, true);
+}
+
+void Parser::feedEnd(bool raw) {
+	assert(feedSource_);
+
+	// Only a frame can be left waiting for the data to go on
+	if (parserState_ == PARSER_STATE_DATA) {
+		parseAvailable(raw, false);
+		pis_.streamClearEof();
+	}
+}
+
+/**
+ * Parse the data the stream has to offer, carrying on from where the last call left off. If more is set, the data may
+ * be continued later: instead of treating the end of it as the end of the log, a header line or frame it cuts short is
+ * rewound to be parsed again next time, and the last frame waits for the next frame's marker to confirm it.
+ *
+ * Returns false if the data turned out not to hold a usable log.
+ */
+bool Parser::parseAvailable(bool raw, bool more) {
+	uint64_t frameEnd;
+	flightLogFrameType_t *frameType;
 
 	while (1) {
-		const char command = pis_.inputPeek();
+		/*
+		 * While searching for the next frame, go straight to the next byte that could start one. The window may end
+		 * short of the data at hand (as when rewound into the history of fed data), so search on into the next.
+		 */
+		if (resyncing_ && !lastFrameType_) {
+			do
+				pis_.streamSkip(markerScanner_.find(pis_.streamPointer(), pis_.streamAvailable()));
+			while (pis_.streamAvailable() == 0 && pis_.refill());
+		}
+
+		// A log ended by an event in fed data is over, whatever comes next belongs to the next log
+		int command = logEnded_ ? EOF : pis_.streamReadChar();
 
-		switch (parserState) {
+		switch (parserState_) {
 		case PARSER_STATE_HEADER:
 			switch (command) {
-			case 'H':
-				pis_.inputTake();
+			case 'H': {
+				const uint64_t lineStart = pis_.streamOffset() - 1;
+
 				parseHeaderLine();
+
+				if (more && pis_.streamEof()) {
+					pis_.streamSeek(lineStart);
+					return true;
+				}
 				break;
+			}
 			case EOF:
+				if (more) {
+					pis_.streamClearEof();
+					return true;
+				}
+
 				fprintf(stderr, "Data file contained no events\n");
 				return false;
 			default:
 				frameType = getFrameType(command);
 
+				// Fed data can start anywhere, frames without a header to decode them are as good as garbage
+				if (frameType && more && frameDef('I')->fieldCount == 0)
+					frameType = NULL;
+
 				if (frameType) {
-					if (frameDefs_['I'].fieldCount == 0) {
+					pis_.streamUnreadChar(command);
+
+					if (frameDef('I')->fieldCount == 0) {
 						fprintf(stderr, "Data file is missing field name definitions\n");
 						return false;
 					}
 
-					/* Home coord predictors appear in pairs (lat/lon), but the predictor ID is the same for both. It's easier to
-					 * apply the right predictor during parsing if we rewrite the predictor ID for the second half of the pair here:
-					 */
-					for (int i = 1; i < frameDefs_['G'].fieldCount; i++) {
-						if (frameDefs_['G'].predictor[i - 1] == FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD && frameDefs_['G'].predictor[i] == FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD) {
-							frameDefs_['G'].predictor[i] = FLIGHT_LOG_FIELD_PREDICTOR_HOME_COORD_1;
-						}
-					}
-
-					parserState = PARSER_STATE_DATA;
-					lastFrameTypemainHistory_[L;
-					frameStart = prvt->stream->pos;
-
-					if (onMetadataReady)
-						onMetadataReady(log);
+					finishHeader(raw);
+					flightLogMetadataReady();
 				} // else skip garbage which apparently precedes the first data frame
 				break;
 			}
 			break;
 		case PARSER_STATE_DATA:
-			if (lastFrameType) {
+			// Only the next frame's marker can tell whether the last frame ended where it should, so wait for it
+			if (command == EOF && more && !logEnded_) {
+				pis_.streamClearEof();
+				return true;
+			}
+
+			// The frame we just read ends where this command byte begins
+			frameEnd = command == EOF ? pis_.streamOffset() : pis_.streamOffset() - 1;
+
+			if (lastFrameType_) {
+				unsigned int lastFrameSize = frameEnd - frameStart_;
+
 				// Is this the beginning of a new frame?
 				frameType = command == EOF ? 0 : getFrameType((uint8_t) command);
 				looksLikeFrameCompleted_ = frameType || (!prematureEof_ && command == EOF);
 
 				// If we see what looks like the beginning of a new frame, assume that the previous frame was valid:
 				if (lastFrameSize <= FLIGHT_LOG_MAX_FRAME_LENGTH && looksLikeFrameCompleted_) {
-					bool frameAccepted = true;
-
-					if (lastFrameType->complete)
-						frameAccepted = lastFrameType->complete(log, pis, lastFrameType->marker, frameStart, frameEnd, raw);
-
-					if (frameAccepted) {
-						//Update statistics for this frame type
-						stats_.frame[lastFrameType->marker].bytes += lastFrameSize;
-						stats_.frame[lastFrameType->marker].sizeCount[lastFrameSize]++;
-						stats_.frame[lastFrameType->marker].validCount++;
-					} else {
-						stats_.frame[lastFrameType->marker].desyncCount++;
+					if (!lastFrameCommitted_) {
+						completeFrame(lastFrameType_, frameEnd, raw);
+					} else if (clockSamplePending_) {
+						clockSync_.add_sample(pendingClockSampleTime_, pendingClockSampleUs_);
+						clockSamplePending_ = false;
 					}
 				} else {
 					//The previous frame was corrupt
 
-//We need to resynchronise before we can deliver another main frame:
+					if (lastFrameCommitted_)
+						retractFrame(lastFrameType_, lastFrameSize);
+
+					//We need to resynchronise before we can deliver another main frame:
 					mainStreamIsValid_ = false;
-					stats_.frame[lastFrameType->marker].corruptCount++;
-					stats_.totalCorruptFrames++;
+					if (statsLevel_ != STATS_OFF) {
+						stats_.frame[lastFrameType_->marker].corruptCount++;
+						stats_.totalCorruptFrames++;
+					}
 
 					//Let the caller know there was a corrupt frame (don't give them a pointer to the frame data because it is totally worthless)
-					if (onFrameReady)
-						onFrameReady(log, false, 0, lastFrameType->marker, 0, frameStart - prvt->stream->data, lastFrameSize);
+					frameReady(false, 0, lastFrameType_->marker, 0, frameStart_, frameEnd);
 
 					/*
 					 * Start the search for a frame beginning after the first byte of the previous corrupt frame.
 					 * This way we can find the start of the next frame after the corrupt frame if the corrupt frame
 					 * was truncated.
 					 */
-					prvt->stream->pos = frameStart + 1;
-					lastFrameType = NULL;
+					pis_.streamSeek(frameStart_ + 1);
+					lastFrameType_ = NULL;
+					lastFrameCommitted_ = false;
 					prematureEof_ = false;
-					prvt->stream->eof = false;
+
+					startResync(frameStart_ + 1);
 					continue;
 				}
 			}
 
-			if (command == EOF)
-				goto done;
+			if (command == EOF) {
+				lastFrameType_ = NULL;
+				lastFrameCommitted_ = false;
+
+				if (!logEnded_)
+					goto done;
+
+				resetLog();
+				continue;
+			}
 
 			frameType = getFrameType((uint8_t) command);
-			frameStart = prvt->stream->pos - 1;
+			frameStart_ = frameEnd;
+
+			if (command == 'H') {
+				const int newLog = startsNewLog(more);
+
+				if (newLog < 0) {
+					pis_.streamSeek(frameStart_);
+					lastFrameType_ = NULL;
+					return true;
+				}
+
+				if (newLog) {
+					const uint64_t headerStart = frameStart_;
+
+					resetLog();
+					pis_.streamSeek(headerStart);
+					continue;
+				}
+			}
+
+			if (resyncing_ && frameType && frameType->marker == 'I' && !plausibleIntraframe(raw)) {
+				frameType = NULL;
+
+				if (statsLevel_ != STATS_OFF)
+					stats_.resyncRejectedIntraframes++;
+			}
 
 			if (frameType) {
-				frameType->parse(log, pis, raw);
+				frameType->parse(*this, raw);
 			} else {
-				prvt->mainStreamIsValid = false;
+				mainStreamIsValid_ = false;
+				startResync(frameStart_);
 			}
 
 			//We shouldn't read an EOF during reading a frame (that'd imply the frame was truncated)
-			if (prvt->stream->eof)
+			if (pis_.streamEof()) {
+				// Unless the data so far simply ends inside it, then decode it again once the rest has arrived
+				if (more && frameType && pis_.streamOffset() - frameStart_ <= FLIGHT_LOG_MAX_FRAME_LENGTH) {
+					pis_.streamSeek(frameStart_);
+					lastFrameType_ = NULL;
+					decodeError_ = DECODE_OK;
+					return true;
+				}
+
 				prematureEof_ = true;
+			}
 
-			lastFrameType = frameType;
+			if (decodeError_ != DECODE_OK) {
+				rejectUndecodableFrame(frameType);
+				continue;
+			}
+
+			lastFrameType_ = frameType;
+			lastFrameCommitted_ = false;
+
+			// Event frames vary in structure, only frames laid out by the header can be trusted before the next marker
+			if (earlyCommit_ && frameType && frameType->marker != 'E' && !pis_.streamEof()
+					&& pis_.streamOffset() - frameStart_ <= FLIGHT_LOG_MAX_FRAME_LENGTH) {
+				committedMainFrameIteration_ = lastMainFrameIteration_;
+				committedMainFrameTime_ = lastMainFrameTime_;
+				committedMainReferencePending_ = mainReferencePending_;
+
+				// Set first, so that frameReady() holds its clock sync sample back until the frame is confirmed
+				lastFrameCommitted_ = true;
+				completeFrame(frameType, pis_.streamOffset(), raw);
+			}
 			break;
 		}
 	}
@@ -2,24 +2,188 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <limits.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <endian.h>
 
 #include "blackbox/tools.h"
+#include "blackbox/ring_buffer.h"
 
-#include "blackbox/stream.h"
+#include "blackbox/parser_input_stream.h"
 
 namespace blackbox {
 
-ParserInputStream::ParserInputStream(int (*getNextByte)()) :
-		getNextByte_(getNextByte), data_(0), bitPos_(0), eof_(false) {
+bool RingBufferInputSource::nextChunk(const uint8_t **data, size_t *length, uint64_t *rxTimeUs) {
+	if (held_) {
+		ring_.consume(held_);
+		held_ = 0;
+	}
+
+	if (!ring_.peek(data, length, rxTimeUs))
+		return false;
+
+	held_ = *length;
+	return true;
+}
+
+bool FeedInputSource::nextChunk(const uint8_t **data, size_t *length, uint64_t *rxTimeUs) {
+	if (!data_)
+		return false;
+
+	*data = data_;
+	*length = length_;
+	*rxTimeUs = rxTimeUs_;
+	data_ = NULL;
+
+	return true;
+}
+
+MappedFile::MappedFile() :
+		data_(NULL), size_(0) {
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const char *path) {
+	struct stat st;
+	int fd;
+
+	close();
+
+	fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) < 0) {
+		::close(fd);
+		return false;
+	}
+
+	if (st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (map == MAP_FAILED) {
+			::close(fd);
+			return false;
+		}
+
+		// Logs are parsed front to back
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+		data_ = (const uint8_t*) map;
+		size_ = st.st_size;
+	}
+
+	// The mapping keeps the file referenced
+	::close(fd);
+
+	return true;
+}
+
+void MappedFile::close() {
+	if (data_)
+		munmap((void*) data_, size_);
+
+	data_ = NULL;
+	size_ = 0;
+}
+
+ParserInputStream::ParserInputStream(ParserInputSource &source) :
+		source_(&source), chunk_(NULL), chunkLength_(0), chunkOffset_(0), historyLength_(0), endOffset_(0), ended_(false), bitBuffer_(0),
+				bitsLeft_(0), eof_(false), arrivalMarkCount_(0) {
+	setWindow(history_, 0, 0, 0);
+}
+
+ParserInputStream::ParserInputStream(const uint8_t *data, size_t length) :
+		source_(NULL), chunk_(data), chunkLength_(length), chunkOffset_(0), historyLength_(0), endOffset_(0), ended_(false), bitBuffer_(0),
+				bitsLeft_(0), eof_(false), arrivalMarkCount_(0) {
+	setWindow(chunk_, chunkLength_, 0, 0);
 }
 
 ParserInputStream::~ParserInputStream() {
-	free (stream);
 }
 
-uint32_t ParserInputStream::streamReadUnsignedVB() {
+void ParserInputStream::setWindow(const uint8_t *base, size_t length, uint64_t baseOffset, uint64_t offset) {
+	if (ended_ && endOffset_ < baseOffset + length)
+		length = endOffset_ > baseOffset ? endOffset_ - baseOffset : 0;
+
+	if (offset > baseOffset + length)
+		offset = baseOffset + length;
+
+	base_ = base;
+	end_ = base + length;
+	pos_ = base + (offset - baseOffset);
+	baseOffset_ = baseOffset;
+}
+
+/**
+ * Keep the tail of the current chunk (together with what is still needed of the history before it) so the parser can
+ * seek back into it once the source has moved on.
+ */
+void ParserInputStream::retireChunk() {
+	if (chunkLength_ >= PARSER_INPUT_HISTORY_SIZE) {
+		memcpy(history_, chunk_ + chunkLength_ - PARSER_INPUT_HISTORY_SIZE, PARSER_INPUT_HISTORY_SIZE);
+		historyLength_ = PARSER_INPUT_HISTORY_SIZE;
+	} else if (chunkLength_ > 0) {
+		size_t keep = PARSER_INPUT_HISTORY_SIZE - chunkLength_;
+
+		if (keep > historyLength_)
+			keep = historyLength_;
+
+		memmove(history_, history_ + historyLength_ - keep, keep);
+		memcpy(history_ + keep, chunk_, chunkLength_);
+		historyLength_ = keep + chunkLength_;
+	}
+
+	chunkOffset_ += chunkLength_;
+	chunkLength_ = 0;
+}
+
+bool ParserInputStream::refill() {
+	const uint64_t offset = windowOffset();
+	const uint8_t *data;
+	size_t length;
+	uint64_t rxTimeUs;
+
+	if (ended_ && offset >= endOffset_)
+		return false;
+
+	// Rewound into the history and reached its end, carry on with the chunk that follows it
+	if (base_ == history_ && chunkLength_ > 0) {
+		setWindow(chunk_, chunkLength_, chunkOffset_, offset);
+		return pos_ < end_;
+	}
+
+	if (!source_)
+		return false;
+
+	retireChunk();
+
+	do {
+		if (!source_->nextChunk(&data, &length, &rxTimeUs)) {
+			setWindow(history_, historyLength_, chunkOffset_ - historyLength_, offset);
+			return false;
+		}
+	} while (length == 0);
+
+	if (rxTimeUs)
+		streamMarkArrival(rxTimeUs);
+
+	chunk_ = data;
+	chunkLength_ = length;
+	setWindow(chunk_, chunkLength_, chunkOffset_, offset);
+
+	return pos_ < end_;
+}
+
+uint32_t ParserInputStream::readUnsignedVBBytewise() {
 	int i, c, shift = 0;
 	uint32_t result = 0;
 
@@ -31,7 +195,7 @@ uint32_t ParserInputStream::streamReadUnsignedVB() {
 			return 0;
 		}
 
-		result = result | ((c & ~0x80) << shift);
+		result = result | ((uint32_t) (c & ~0x80) << shift);
 
 		//Final byte?
 		if (c < 128) {
@@ -45,113 +209,83 @@ uint32_t ParserInputStream::streamReadUnsignedVB() {
 	return 0;
 }
 
-int32_t ParserInputStream::streamReadSignedVB() {
-	uint32_t i = streamReadUnsignedVB();
-
-	// Apply ZigZag decoding to recover the signed value
-	return zigzagDecode(i);
-}
-
-int streamPeekChar() {
-	if (stream->pos < stream->end) {
-		return *stream->pos;
-	}
+void ParserInputStream::streamRead(void *buf, int len) {
+	uint8_t *buffer = (uint8_t*) buf;
 
-	stream->eof = true;
+	while (len > 0) {
+		if (pos_ == end_ && !refill()) {
+			eof_ = true;
+			break;
+		}
 
-	return EOF;
-}
+		size_t count = end_ - pos_ < len ? end_ - pos_ : len;
 
-/**
- * Read an unsigned byte from the stream, or EOF if the end of stream was reached.
- */
-int ParserInputStream::streamReadByte() {
-	return getNextByte_();
+		memcpy(buffer, pos_, count);
+		pos_ += count;
+		buffer += count;
+		len -= count;
+	}
 }
 
-/**
- * Read a char from the stream, or EOF if the end of stream was reached.
- */
-int ParserInputStream::streamReadChar() {
-	if (stream->pos < stream->end) {
-		int result = *stream->pos;
-		stream->pos++;
-		return result;
+bool ParserInputStream::streamSeek(uint64_t offset) {
+	if (chunkLength_ > 0 && offset >= chunkOffset_ && offset <= chunkOffset_ + chunkLength_) {
+		setWindow(chunk_, chunkLength_, chunkOffset_, offset);
+	} else if (offset + historyLength_ >= chunkOffset_ && offset <= chunkOffset_) {
+		setWindow(history_, historyLength_, chunkOffset_ - historyLength_, offset);
+	} else {
+		return false;
 	}
 
-	stream->eof = true;
+	bitBuffer_ = 0;
+	bitsLeft_ = 0;
+	eof_ = false;
 
-	return EOF;
+	return true;
 }
 
-void streamUnreadChar(mmapStream_t *stream, int c) {
-	(void) c;
-
-	stream->pos--;
+void ParserInputStream::streamEnd() {
+	endOffset_ = windowOffset();
+	ended_ = true;
+	end_ = pos_;
 }
 
-void ParserInputStream::streamRead(mmapStream_t *stream, void *buf, int len) {
-	char *buffer = (char*) buf;
+bool ParserInputStream::fillBits(int numBits) {
+	assert(numBits <= PARSER_INPUT_PEEK_BITS);
 
-	if (len > stream->end - stream->pos) {
-		len = stream->end - stream->pos;
-		stream->eof = true;
-	}
+	// Common case: take as many whole bytes as fit with one unaligned big-endian load
+	if (end_ - pos_ >= 8) {
+		uint64_t word;
+		int bytes = (64 - bitsLeft_) >> 3;
 
-	for (int i = 0; i < len; i++, stream->pos++, buffer++) {
-		*buffer = *stream->pos;
-	}
-}
+		memcpy(&word, pos_, sizeof(word));
+		word = be64toh(word);
 
-/**
- * Read `numBits` (at most 32) at the current bit index and advance the bit pointer. The first bit in the stream becomes
- * the highest bit set in the result, and the last bit in the stream will be the least significant bit in the result.
- *
- * It is an error to later attempt to read a *byte* from the stream if the bit pointer is not byte-aligned (call streamByteAlign).
- *
- * If EOF is encountered before all the requested bits were read, the `pos` is set to the end of the stream, EOF is
- * returned, the EOF flag is set, and the bit pointer is properly aligned.
- */
-uint32_t ParserInputStream::streamReadBits(int numBits) {
-	// Round up the bit count to get the byte count
-	int numBytes = (numBits + CHAR_BIT - 1) / CHAR_BIT;
+		bitBuffer_ |= word >> bitsLeft_;
+		bitsLeft_ += bytes << 3;
+		pos_ += bytes;
 
-	assert(numBits <= 32);
+		// Drop the part of a byte that didn't fit, refills OR into these bits
+		if (bitsLeft_ < 64)
+			bitBuffer_ &= ~(~(uint64_t) 0 >> bitsLeft_);
 
-	if (stream->pos + numBytes <= stream->end) {
-		uint32_t result = 0;
+		return true;
+	}
 
-		while (numBits > 0) {
-			result |= ((((uint8_t) *stream->pos) >> stream->bitPos) & 0x01) << (numBits - 1);
+	// Near the end of the window, fetch only the bytes actually needed so we never hit EOF (or refill) early
+	while (bitsLeft_ < numBits) {
+		int c = streamReadByte();
 
-			if (stream->bitPos == 0) {
-				stream->pos++;
-				stream->bitPos = CHAR_BIT - 1;
-			} else {
-				stream->bitPos--;
-			}
-			numBits--;
+		if (c == EOF) {
+			bitBuffer_ = 0;
+			bitsLeft_ = 0;
+			return false;
 		}
 
-		return result;
-	} else {
-		stream->pos = stream->end;
-		stream->eof = true;
-		stream->bitPos = CHAR_BIT - 1;
-		return EOF;
+		bitBuffer_ |= (uint64_t) c << (56 - bitsLeft_);
+		bitsLeft_ += CHAR_BIT;
 	}
-}
 
-/**
- * Read the bit at the current bit index and advance the bit pointer. Returns 1 if the bit was set and 0 if the bit
- * was not set.
- *
- * It is an error to later attempt to read a *byte* from the stream if the bit pointer is not byte-aligned (call streamByteAlign).
- *
- * If the file was already at EOF, EOF is returned and the EOF flag is set, and the bit pointer is byte-aligned.
- */
-int ParserInputStream::streamReadBit() {
-	return streamReadBits(stream, 1);
+	return true;
 }
 
 /**
@@ -160,10 +294,47 @@ int ParserInputStream::streamReadBit() {
  * EOF is never set by this routine as the routine never needs to attempt to read beyond the end of the stream.
  */
 void ParserInputStream::streamByteAlign() {
-	if (stream->bitPos != CHAR_BIT - 1) {
-		stream->bitPos = CHAR_BIT - 1;
-		stream->pos++;
+	size_t unread = bitsLeft_ >> 3;
+
+	bitBuffer_ = 0;
+	bitsLeft_ = 0;
+
+	// Give back the whole bytes the reservoir took ahead of time
+	if (unread) {
+		if ((size_t) (pos_ - base_) >= unread)
+			pos_ -= unread;
+		else
+			streamSeek(windowOffset() - unread);
+	}
+}
+
+void ParserInputStream::streamMarkArrival(uint64_t rxTimeUs) {
+	const uint64_t fetched = chunkOffset_ + chunkLength_;
+
+	// Nothing fetched since the last mark, so it never applied to any byte
+	if (arrivalMarkCount_ > 0 && arrivalMarks_[(arrivalMarkCount_ - 1) % PARSER_INPUT_ARRIVAL_MARKS].offset == fetched) {
+		arrivalMarkCount_--;
+	}
+
+	ArrivalMark &mark = arrivalMarks_[arrivalMarkCount_ % PARSER_INPUT_ARRIVAL_MARKS];
+
+	mark.offset = fetched;
+	mark.rxTimeUs = rxTimeUs;
+	arrivalMarkCount_++;
+}
+
+uint64_t ParserInputStream::streamArrivalTime(uint64_t offset) const {
+	unsigned int oldest = arrivalMarkCount_ > PARSER_INPUT_ARRIVAL_MARKS ? arrivalMarkCount_ - PARSER_INPUT_ARRIVAL_MARKS : 0;
+
+	// Most lookups are for bytes we just read, so search from the newest mark back
+	for (unsigned int i = arrivalMarkCount_; i > oldest; i--) {
+		const ArrivalMark &mark = arrivalMarks_[(i - 1) % PARSER_INPUT_ARRIVAL_MARKS];
+
+		if (mark.offset <= offset)
+			return mark.rxTimeUs;
 	}
+
+	return 0;
 }
 
 }
@@ -0,0 +1,94 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <blackbox/pty_transport.h>
+#include <ros/ros.h>
+
+namespace blackbox {
+
+PtyTransport::PtyTransport(SerialListener * const listener, size_t read_size) :
+		Transport(listener, read_size), master_(io_service_), slave_fd_(-1) {
+	int master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (master_fd < 0 || grantpt(master_fd) < 0 || unlockpt(master_fd) < 0) {
+		std::string error = std::string("Failed to create pseudo-terminal: ") + strerror(errno);
+
+		if (master_fd >= 0)
+			::close(master_fd);
+		throw SerialException(error);
+	}
+
+	// The line discipline must pass binary blackbox data through untouched
+	struct termios tio;
+
+	if (tcgetattr(master_fd, &tio) < 0) {
+		std::string error = std::string("Failed to get pseudo-terminal attributes: ") + strerror(errno);
+
+		::close(master_fd);
+		throw SerialException(error);
+	}
+
+	cfmakeraw(&tio);
+
+	if (tcsetattr(master_fd, TCSANOW, &tio) < 0) {
+		std::string error = std::string("Failed to set pseudo-terminal attributes: ") + strerror(errno);
+
+		::close(master_fd);
+		throw SerialException(error);
+	}
+
+	const char *slave_name = ptsname(master_fd);
+
+	if (!slave_name) {
+		std::string error = std::string("Failed to get pseudo-terminal name: ") + strerror(errno);
+
+		::close(master_fd);
+		throw SerialException(error);
+	}
+
+	slave_name_ = slave_name;
+	slave_fd_ = open(slave_name_.c_str(), O_RDWR | O_NOCTTY);
+
+	if (slave_fd_ < 0) {
+		std::string error = "Failed to open " + slave_name_ + ": " + strerror(errno);
+
+		::close(master_fd);
+		throw SerialException(error);
+	}
+
+	master_.assign(master_fd);
+
+	ROS_INFO("Blackbox pseudo-terminal at %s", slave_name_.c_str());
+
+	start();
+}
+
+PtyTransport::~PtyTransport() {
+	close();
+
+	if (slave_fd_ >= 0)
+		::close(slave_fd_);
+}
+
+bool PtyTransport::is_open() {
+	return master_.is_open();
+}
+
+void PtyTransport::async_read_some(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) {
+	master_.async_read_some(buffer, handler);
+}
+
+void PtyTransport::async_write(const WriteBuffers &buffers, const IoHandler &handler) {
+	boost::asio::async_write(master_, buffers, handler);
+}
+
+void PtyTransport::close_device() {
+	boost::system::error_code ignored;
+	master_.close(ignored);
+}
+
+}
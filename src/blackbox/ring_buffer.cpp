@@ -0,0 +1,86 @@
+#include <string.h>
+
+#include "blackbox/ring_buffer.h"
+
+namespace blackbox {
+
+static size_t roundUpToPowerOfTwo(size_t value) {
+	size_t result = 1;
+
+	while (result < value)
+		result <<= 1;
+
+	return result;
+}
+
+RingBuffer::RingBuffer(size_t capacity) :
+		capacity_(roundUpToPowerOfTwo(capacity)), mask_(capacity_ - 1), head_(0), tail_(0),
+		// Every chunk holds at least one byte, but reads are rarely that small
+		chunks_(capacity_ / 16 < 64 ? 64 : capacity_ / 16), chunk_remaining_(0), chunk_rx_time_us_(0), high_water_mark_(0),
+		overflow_count_(0) {
+	data_ = new uint8_t[capacity_];
+}
+
+RingBuffer::~RingBuffer() {
+	delete[] data_;
+}
+
+bool RingBuffer::write(const uint8_t * const data, const size_t length, const uint64_t rx_time_us) {
+	const size_t head = head_.load(boost::memory_order_relaxed);
+	const size_t used = head - tail_.load(boost::memory_order_acquire);
+
+	if (length == 0)
+		return true;
+
+	if (length > capacity_ - used || !chunks_.write_available()) {
+		overflow_count_.fetch_add(1, boost::memory_order_relaxed);
+		return false;
+	}
+
+	// Copy in at most two parts, the second one wrapping around to the start of the storage
+	const size_t offset = head & mask_;
+	const size_t first = length < capacity_ - offset ? length : capacity_ - offset;
+
+	memcpy(data_ + offset, data, first);
+	memcpy(data_, data + first, length - first);
+
+	head_.store(head + length, boost::memory_order_release);
+
+	Chunk chunk;
+	chunk.length = length;
+	chunk.rx_time_us = rx_time_us;
+	chunks_.push(chunk);
+
+	if (used + length > high_water_mark_.load(boost::memory_order_relaxed))
+		high_water_mark_.store(used + length, boost::memory_order_relaxed);
+
+	return true;
+}
+
+bool RingBuffer::peek(const uint8_t **data, size_t *length, uint64_t *rx_time_us) {
+	if (chunk_remaining_ == 0) {
+		Chunk chunk;
+
+		// The chunk record is pushed after its bytes, so once we see it the bytes are there too
+		if (!chunks_.pop(chunk))
+			return false;
+
+		chunk_remaining_ = chunk.length;
+		chunk_rx_time_us_ = chunk.rx_time_us;
+	}
+
+	const size_t offset = tail_.load(boost::memory_order_relaxed) & mask_;
+
+	*data = data_ + offset;
+	*length = chunk_remaining_ < capacity_ - offset ? chunk_remaining_ : capacity_ - offset;
+	*rx_time_us = chunk_rx_time_us_;
+
+	return true;
+}
+
+void RingBuffer::consume(const size_t length) {
+	chunk_remaining_ -= length;
+	tail_.store(tail_.load(boost::memory_order_relaxed) + length, boost::memory_order_release);
+}
+
+}
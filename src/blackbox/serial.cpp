@@ -1,121 +1,75 @@
 #include <exception>
 #include <blackbox/serial.h>
-#include <boost/thread.hpp>
 #include <ros/ros.h>
 
 namespace blackbox {
 
 using boost::asio::serial_port_base;
 
-Serial::Serial(std::string port, int baud_rate, SerialListener * const listener) :
-		io_service_(), serial_port_(io_service_), write_in_progress_(false), listener_(listener) {
-	// setup serial port
+Serial::Serial(std::string port, const SerialOptions &options, SerialListener * const listener, size_t read_size) :
+		Transport(listener, read_size), port_(port), options_(options), serial_port_(io_service_) {
+	open_port();
+
+	// start reading from serial port
+	start();
+}
+
+void Serial::open_port() {
 	try {
-		serial_port_.open(port);
-		serial_port_.set_option(serial_port_base::baud_rate(baud_rate));
-		serial_port_.set_option(serial_port_base::character_size(8));
-		serial_port_.set_option(serial_port_base::parity(serial_port_base::parity::none));
-		serial_port_.set_option(serial_port_base::stop_bits(serial_port_base::stop_bits::one));
-		serial_port_.set_option(serial_port_base::flow_control(serial_port_base::flow_control::none));
+		serial_port_.open(port_);
+
+		if (options_.low_latency) {
+			// termios2 handles non-standard rates like 1.5M and 2M, which serial_port_base::baud_rate rejects
+			termios_configure(serial_port_.native_handle(), options_);
+
+			if (!termios_set_low_latency(serial_port_.native_handle(), true))
+				ROS_WARN("%s does not support ASYNC_LOW_LATENCY", port_.c_str());
+		} else {
+			serial_port_.set_option(serial_port_base::baud_rate(options_.baud_rate));
+			serial_port_.set_option(serial_port_base::character_size(8));
+			serial_port_.set_option(serial_port_base::parity(serial_port_base::parity::none));
+			serial_port_.set_option(serial_port_base::stop_bits(serial_port_base::stop_bits::one));
+			serial_port_.set_option(
+					serial_port_base::flow_control(options_.rtscts ? serial_port_base::flow_control::hardware : serial_port_base::flow_control::none));
+		}
 	} catch (boost::system::system_error &e) {
+		close_device();
 		throw SerialException(e);
+	} catch (SerialException &e) {
+		// Left open, the port would make every reopen_device() fail as already open
+		close_device();
+		throw;
 	}
-
-	// start reading from serial port
-	do_async_read();
-	io_thread_ = boost::thread(boost::bind(&boost::asio::io_service::run, &this->io_service_));
 }
 
 Serial::~Serial() {
 	close();
 }
 
-void Serial::close() {
-	mutex_lock lock(mutex_);
-
-	io_service_.stop();
-	serial_port_.close();
-
-	if (io_thread_.joinable()) {
-		io_thread_.join();
-	}
+bool Serial::is_open() {
+	return serial_port_.is_open();
 }
 
-void Serial::do_async_read() {
-	if (!serial_port_.is_open())
-		return;
-
-	serial_port_.async_read_some(boost::asio::buffer(read_buf_raw_, SERIAL_READ_BUF_SIZE),
-			boost::bind(&Serial::async_read_end, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+void Serial::async_read_some(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) {
+	serial_port_.async_read_some(buffer, handler);
 }
 
-void Serial::async_read_end(const boost::system::error_code &error, size_t bytes_transferred) {
-	if (!serial_port_.is_open())
-		return;
-
-	if (error) {
-		close();
-		return;
-	}
-
-	for (int i = 0 ; i < bytes_transferred ; i++) {
-		listener_->serial_data_received(read_buf_raw_[i]);
-	}
-
-	do_async_read();
+void Serial::async_write(const WriteBuffers &buffers, const IoHandler &handler) {
+	boost::asio::async_write(serial_port_, buffers, handler);
 }
 
-void Serial::send_data(const uint8_t* const data, const size_t length) {
-	WriteBuffer *buffer = new WriteBuffer();
-	buffer->len = length;
-	assert(buffer->len <= SERIAL_WRITE_BUF_SIZE); //! \todo Do something less catastrophic here
-
-	{
-		mutex_lock lock(mutex_);
-		write_queue_.push_back(buffer);
-	}
-
-	do_async_write(true);
+void Serial::close_device() {
+	boost::system::error_code ignored;
+	serial_port_.close(ignored);
 }
 
-void Serial::do_async_write(bool check_write_state) {
-	if (check_write_state && write_in_progress_)
-		return;
-
-	mutex_lock lock(mutex_);
-	if (write_queue_.empty())
-		return;
-
-	write_in_progress_ = true;
-	WriteBuffer *buffer = write_queue_.front();
-	serial_port_.async_write_some(boost::asio::buffer(buffer->dpos(), buffer->nbytes()),
-			boost::bind(&Serial::async_write_end, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
-
+bool Serial::reconnectable() {
+	// A USB adapter that drops off the bus comes back under the same name
+	return true;
 }
 
-void Serial::async_write_end(const boost::system::error_code &error, std::size_t bytes_transferred) {
-	if (error) {
-		close();
-		return;
-	}
-
-	mutex_lock lock(mutex_);
-	if (write_queue_.empty()) {
-		write_in_progress_ = false;
-		return;
-	}
-
-	WriteBuffer *buffer = write_queue_.front();
-	buffer->pos += bytes_transferred;
-	if (buffer->nbytes() == 0) {
-		write_queue_.pop_front();
-		delete buffer;
-	}
-
-	if (write_queue_.empty())
-		write_in_progress_ = false;
-	else
-		do_async_write(false);
+void Serial::reopen_device() {
+	open_port();
 }
 
 }
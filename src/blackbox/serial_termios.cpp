@@ -0,0 +1,61 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+// termios2 and BOTHER; must not be mixed with <termios.h>
+#include <asm/termbits.h>
+#include <linux/serial.h>
+
+#include <string>
+
+#include "blackbox/serial_exception.h"
+#include "blackbox/serial_termios.h"
+
+namespace blackbox {
+
+void termios_configure(int fd, const SerialOptions &options) {
+	struct termios2 tio;
+
+	if (ioctl(fd, TCGETS2, &tio) < 0)
+		throw SerialException(std::string("TCGETS2 failed: ") + strerror(errno));
+
+	// Raw mode, the equivalent of cfmakeraw()
+	tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY);
+	tio.c_oflag &= ~OPOST;
+	tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+
+	// 8N1, receiver on, ignore modem lines
+	tio.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS);
+	tio.c_cflag |= CS8 | CREAD | CLOCAL;
+
+	if (options.rtscts)
+		tio.c_cflag |= CRTSCTS;
+
+	// BOTHER takes the rate from c_ispeed/c_ospeed so rates such as 1500000 and 2000000 work on any capable UART
+	tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+	tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+	tio.c_ispeed = options.baud_rate;
+	tio.c_ospeed = options.baud_rate;
+
+	tio.c_cc[VMIN] = options.vmin;
+	tio.c_cc[VTIME] = options.vtime;
+
+	if (ioctl(fd, TCSETS2, &tio) < 0)
+		throw SerialException(std::string("TCSETS2 failed: ") + strerror(errno));
+}
+
+bool termios_set_low_latency(int fd, bool low_latency) {
+	struct serial_struct serial;
+
+	if (ioctl(fd, TIOCGSERIAL, &serial) < 0)
+		return false;
+
+	if (low_latency)
+		serial.flags |= ASYNC_LOW_LATENCY;
+	else
+		serial.flags &= ~ASYNC_LOW_LATENCY;
+
+	return ioctl(fd, TIOCSSERIAL, &serial) == 0;
+}
+
+}
@@ -0,0 +1,57 @@
+#include <blackbox/tcp_transport.h>
+#include <boost/lexical_cast.hpp>
+
+namespace blackbox {
+
+using boost::asio::ip::tcp;
+
+TcpTransport::TcpTransport(const std::string &host, int port, SerialListener * const listener, size_t read_size) :
+		Transport(listener, read_size), host_(host), port_(port), socket_(io_service_) {
+	connect();
+	start();
+}
+
+void TcpTransport::connect() {
+	try {
+		tcp::resolver resolver(io_service_);
+		boost::asio::connect(socket_, resolver.resolve(tcp::resolver::query(host_, boost::lexical_cast<std::string>(port_))));
+
+		// Uplink commands are small and latency sensitive
+		socket_.set_option(tcp::no_delay(true));
+	} catch (boost::system::system_error &e) {
+		close_device();
+		throw SerialException(e);
+	}
+}
+
+TcpTransport::~TcpTransport() {
+	close();
+}
+
+bool TcpTransport::is_open() {
+	return socket_.is_open();
+}
+
+void TcpTransport::async_read_some(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) {
+	socket_.async_read_some(buffer, handler);
+}
+
+void TcpTransport::async_write(const WriteBuffers &buffers, const IoHandler &handler) {
+	boost::asio::async_write(socket_, buffers, handler);
+}
+
+void TcpTransport::close_device() {
+	boost::system::error_code ignored;
+	socket_.shutdown(tcp::socket::shutdown_both, ignored);
+	socket_.close(ignored);
+}
+
+bool TcpTransport::reconnectable() {
+	return true;
+}
+
+void TcpTransport::reopen_device() {
+	connect();
+}
+
+}
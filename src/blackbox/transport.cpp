@@ -0,0 +1,438 @@
+#include <string.h>
+
+#include <blackbox/transport.h>
+#include <blackbox/serial.h>
+#include <blackbox/pty_transport.h>
+#include <blackbox/udp_transport.h>
+#include <blackbox/tcp_transport.h>
+#include <blackbox/file_transport.h>
+#include <ros/ros.h>
+
+namespace blackbox {
+
+static int histogram_bucket(size_t bytes) {
+	int bucket = 0;
+
+	while (bytes > 1 && bucket < TRANSPORT_READ_HISTOGRAM_BUCKETS - 1) {
+		bytes >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+Transport::Transport(SerialListener * const listener, size_t read_size) :
+		io_service_(), listener_(listener), read_index_(0), read_size_(read_size ? read_size : SERIAL_READ_BUF_SIZE),
+				read_min_size_(read_size ? read_size : SERIAL_READ_MIN_SIZE), read_max_size_(read_size ? read_size : SERIAL_READ_MAX_SIZE),
+				read_average_(read_size_ << 4), rx_ring_(SERIAL_RX_RING_SIZE), decoding_(true), write_head_(0), write_tail_(0),
+				write_inflight_(0), write_in_progress_(false), connection_state_(CONNECTION_CLOSED), reconnect_timer_(io_service_),
+				reconnect_backoff_ms_(SERIAL_RECONNECT_MIN_MS), disconnect_time_us_(0), reopening_(false), rx_bytes_(0), tx_bytes_(0), read_count_(0),
+				write_count_(0), write_queue_depth_(0), write_queue_max_depth_(0), write_latency_count_(0), write_latency_sum_us_(0), write_latency_max_us_(0),
+				connection_event_pending_(false) {
+	for (int i = 0; i < TRANSPORT_READ_HISTOGRAM_BUCKETS; i++) {
+		read_histogram_[i] = 0;
+	}
+
+	for (int i = 0; i < SERIAL_READ_BUFFERS; i++) {
+		read_bufs_[i].resize(read_max_size_);
+	}
+}
+
+Transport::~Transport() {
+}
+
+void Transport::start() {
+	{
+		mutex_lock lock(mutex_);
+
+		connection_stats_.connects++;
+		set_connection_state(CONNECTION_CONNECTED);
+	}
+
+	// listener callbacks run on their own thread so a slow consumer never delays the next read
+	decode_thread_ = boost::thread(boost::bind(&Transport::decode_loop, this));
+
+	do_async_read();
+	io_thread_ = boost::thread(boost::bind(&boost::asio::io_service::run, &this->io_service_));
+}
+
+void Transport::close() {
+	{
+		mutex_lock lock(mutex_);
+
+		io_service_.stop();
+		// A reconnect in progress closes the device itself once it sees the new state
+		if (!reopening_ && is_open())
+			close_device();
+
+		if (connection_state_ != CONNECTION_CLOSED)
+			set_connection_state(CONNECTION_CLOSED);
+	}
+
+	// close() is also reached from handlers running on the I/O thread, which can't join itself
+	if (io_thread_.joinable() && io_thread_.get_id() != boost::this_thread::get_id()) {
+		io_thread_.join();
+	}
+
+	{
+		boost::lock_guard<boost::mutex> decode_lock(decode_mutex_);
+		decoding_ = false;
+	}
+	decode_cond_.notify_one();
+
+	if (decode_thread_.joinable() && decode_thread_.get_id() != boost::this_thread::get_id()) {
+		decode_thread_.join();
+	}
+}
+
+void Transport::do_async_read() {
+	if (!is_open())
+		return;
+
+	async_read_some(boost::asio::buffer(&read_bufs_[read_index_][0], read_size_),
+			boost::bind(&Transport::async_read_end, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void Transport::async_read_end(const boost::system::error_code &error, size_t bytes_transferred) {
+	if (!is_open())
+		return;
+
+	const uint64_t rx_time_us = monotonic_time_us();
+
+	if (error) {
+		io_error(error);
+		return;
+	}
+
+	const uint8_t * const chunk = &read_bufs_[read_index_][0];
+
+	rx_bytes_.fetch_add(bytes_transferred, boost::memory_order_relaxed);
+	read_count_.fetch_add(1, boost::memory_order_relaxed);
+	read_histogram_[histogram_bucket(bytes_transferred)].fetch_add(1, boost::memory_order_relaxed);
+
+	// Get the next read going into the other buffer before handing this chunk off
+	adapt_read_size(bytes_transferred);
+	read_index_ = (read_index_ + 1) % SERIAL_READ_BUFFERS;
+	do_async_read();
+
+	// on overflow the chunk is dropped and counted; the parser resynchronises on the next frame
+	rx_ring_.write(chunk, bytes_transferred, rx_time_us);
+
+	{
+		boost::lock_guard<boost::mutex> decode_lock(decode_mutex_);
+	}
+	decode_cond_.notify_one();
+}
+
+void Transport::adapt_read_size(const size_t bytes_transferred) {
+	if (read_min_size_ == read_max_size_)
+		return;
+
+	read_average_ += bytes_transferred - (read_average_ >> 4);
+
+	if (bytes_transferred == read_size_) {
+		// More was probably waiting, read bigger chunks and wake up less often
+		read_size_ = read_size_ * 2 < read_max_size_ ? read_size_ * 2 : read_max_size_;
+	} else if (read_size_ > read_min_size_ && read_average_ >> 4 < read_size_ / 4) {
+		read_size_ /= 2;
+	}
+}
+
+void Transport::decode_loop() {
+	const uint8_t *data;
+	size_t length;
+	uint64_t rx_time_us;
+
+	while (true) {
+		deliver_connection_events();
+
+		if (rx_ring_.peek(&data, &length, &rx_time_us)) {
+			listener_->serial_data_received(data, length, rx_time_us);
+			rx_ring_.consume(length);
+			continue;
+		}
+
+		boost::unique_lock<boost::mutex> decode_lock(decode_mutex_);
+		while (decoding_ && rx_ring_.empty() && !connection_events_.read_available() && !connection_event_pending_) {
+			decode_cond_.wait(decode_lock);
+		}
+
+		// Deliver whatever is still queued before stopping
+		if (!decoding_ && rx_ring_.empty()) {
+			deliver_connection_events();
+			return;
+		}
+	}
+}
+
+bool Transport::send_data(const uint8_t* const data, const size_t length) {
+	const size_t slots_needed = (length + SERIAL_WRITE_BUF_SIZE - 1) / SERIAL_WRITE_BUF_SIZE;
+	const uint64_t queued_us = monotonic_time_us();
+
+	mutex_lock lock(mutex_);
+
+	if (connection_state_ != CONNECTION_CONNECTED || !is_open() || slots_needed > SERIAL_WRITE_SLOTS - (write_head_ - write_tail_))
+		return false;
+
+	for (size_t pos = 0; pos < length; pos += SERIAL_WRITE_BUF_SIZE) {
+		WriteSlot &slot = write_slots_[write_head_ & (SERIAL_WRITE_SLOTS - 1)];
+
+		slot.len = length - pos < SERIAL_WRITE_BUF_SIZE ? length - pos : SERIAL_WRITE_BUF_SIZE;
+		slot.queued_us = queued_us;
+		memcpy(slot.data, data + pos, slot.len);
+		write_head_++;
+	}
+
+	write_queue_depth_.store(write_head_ - write_tail_, boost::memory_order_relaxed);
+	if (write_head_ - write_tail_ > write_queue_max_depth_.load(boost::memory_order_relaxed))
+		write_queue_max_depth_.store(write_head_ - write_tail_, boost::memory_order_relaxed);
+
+	// Otherwise async_write_end picks the new slots up together with anything else queued meanwhile
+	if (!write_in_progress_)
+		do_async_write();
+
+	return true;
+}
+
+void Transport::do_async_write() {
+	if (write_head_ == write_tail_) {
+		write_in_progress_ = false;
+		return;
+	}
+
+	// Gather every queued slot into one write, unused trailing buffers stay empty and are skipped by asio
+	write_inflight_ = write_head_ - write_tail_;
+	for (size_t i = 0; i < SERIAL_WRITE_SLOTS; i++) {
+		if (i < write_inflight_) {
+			const WriteSlot &slot = write_slots_[(write_tail_ + i) & (SERIAL_WRITE_SLOTS - 1)];
+			write_buffers_[i] = boost::asio::const_buffer(slot.data, slot.len);
+		} else {
+			write_buffers_[i] = boost::asio::const_buffer();
+		}
+	}
+
+	write_in_progress_ = true;
+	async_write(write_buffers_,
+			boost::bind(&Transport::async_write_end, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void Transport::async_write_end(const boost::system::error_code &error, std::size_t bytes_transferred) {
+	if (error) {
+		io_error(error);
+		return;
+	}
+
+	const uint64_t now_us = monotonic_time_us();
+
+	mutex_lock lock(mutex_);
+
+	tx_bytes_.fetch_add(bytes_transferred, boost::memory_order_relaxed);
+	write_count_.fetch_add(1, boost::memory_order_relaxed);
+
+	for (size_t i = 0; i < write_inflight_; i++) {
+		const uint64_t latency_us = now_us - write_slots_[(write_tail_ + i) & (SERIAL_WRITE_SLOTS - 1)].queued_us;
+
+		write_latency_sum_us_.fetch_add(latency_us, boost::memory_order_relaxed);
+		if (latency_us > write_latency_max_us_.load(boost::memory_order_relaxed))
+			write_latency_max_us_.store(latency_us, boost::memory_order_relaxed);
+	}
+	write_latency_count_.fetch_add(write_inflight_, boost::memory_order_relaxed);
+
+	// async_write only completes without error once every gathered byte has been sent
+	write_tail_ += write_inflight_;
+	write_inflight_ = 0;
+	write_queue_depth_.store(write_head_ - write_tail_, boost::memory_order_relaxed);
+
+	do_async_write();
+}
+
+TransportStats Transport::stats() {
+	TransportStats stats;
+
+	stats.rx_bytes = rx_bytes_.load(boost::memory_order_relaxed);
+	stats.tx_bytes = tx_bytes_.load(boost::memory_order_relaxed);
+	stats.read_count = read_count_.load(boost::memory_order_relaxed);
+	stats.write_count = write_count_.load(boost::memory_order_relaxed);
+	for (int i = 0; i < TRANSPORT_READ_HISTOGRAM_BUCKETS; i++) {
+		stats.read_histogram[i] = read_histogram_[i].load(boost::memory_order_relaxed);
+	}
+
+	stats.write_queue_depth = write_queue_depth_.load(boost::memory_order_relaxed);
+	stats.write_queue_max_depth = write_queue_max_depth_.load(boost::memory_order_relaxed);
+
+	stats.write_latency_count = write_latency_count_.load(boost::memory_order_relaxed);
+	stats.write_latency_sum_us = write_latency_sum_us_.load(boost::memory_order_relaxed);
+	stats.write_latency_max_us = write_latency_max_us_.load(boost::memory_order_relaxed);
+
+	stats.rx_high_water_mark = rx_ring_.high_water_mark();
+	stats.rx_overflow_count = rx_ring_.overflow_count();
+
+	return stats;
+}
+
+ConnectionState Transport::connection_state() {
+	mutex_lock lock(mutex_);
+	return connection_state_;
+}
+
+ConnectionStats Transport::connection_stats() {
+	mutex_lock lock(mutex_);
+	return connection_stats_;
+}
+
+void Transport::io_error(const boost::system::error_code &error) {
+	{
+		mutex_lock lock(mutex_);
+
+		// Reads and writes both fail when the link drops, and aborted operations complete after the close
+		if (connection_state_ != CONNECTION_CONNECTED)
+			return;
+
+		connection_stats_.disconnects++;
+
+		if (reconnectable()) {
+			ROS_WARN("Connection lost (%s), reconnecting", error.message().c_str());
+
+			close_device();
+
+			// Whatever was queued was meant for the old link
+			write_tail_ = write_head_;
+			write_inflight_ = 0;
+			write_in_progress_ = false;
+			write_queue_depth_.store(0, boost::memory_order_relaxed);
+
+			disconnect_time_us_ = monotonic_time_us();
+			reconnect_backoff_ms_ = SERIAL_RECONNECT_MIN_MS;
+			set_connection_state(CONNECTION_RECONNECTING);
+			schedule_reconnect();
+			return;
+		}
+
+		set_connection_state(CONNECTION_CLOSED);
+	}
+
+	close();
+}
+
+void Transport::set_connection_state(const ConnectionState state) {
+	ConnectionEvent event;
+
+	connection_state_ = state;
+
+	event.position = rx_ring_.write_position();
+	event.state = state;
+	event.stats = connection_stats_;
+
+	{
+		boost::lock_guard<boost::mutex> decode_lock(decode_mutex_);
+
+		// Once a change has been set aside, later ones must follow it rather than overtake it through the queue
+		if (connection_event_pending_ || !connection_events_.push(event)) {
+			pending_connection_event_ = event;
+			connection_event_pending_ = true;
+		}
+	}
+	decode_cond_.notify_one();
+}
+
+void Transport::deliver_connection_events() {
+	while (connection_events_.read_available()) {
+		const ConnectionEvent &event = connection_events_.front();
+
+		// Free running positions, so compare the distance rather than the values
+		if ((ptrdiff_t) (event.position - rx_ring_.read_position()) > 0)
+			return;
+
+		listener_->serial_connection_changed(event.state, event.stats);
+		connection_events_.pop();
+	}
+
+	ConnectionEvent event;
+
+	{
+		boost::lock_guard<boost::mutex> decode_lock(decode_mutex_);
+
+		// Newer than anything that was in connection_events_, and nothing joins the queue while it is pending
+		if (!connection_event_pending_ || (ptrdiff_t) (pending_connection_event_.position - rx_ring_.read_position()) > 0)
+			return;
+
+		event = pending_connection_event_;
+		connection_event_pending_ = false;
+	}
+
+	listener_->serial_connection_changed(event.state, event.stats);
+}
+
+void Transport::schedule_reconnect() {
+	reconnect_timer_.expires_from_now(boost::posix_time::milliseconds(reconnect_backoff_ms_));
+	reconnect_timer_.async_wait(boost::bind(&Transport::reconnect, this, boost::asio::placeholders::error));
+}
+
+void Transport::reconnect(const boost::system::error_code &error) {
+	if (error)
+		return;
+
+	{
+		mutex_lock lock(mutex_);
+
+		if (connection_state_ != CONNECTION_RECONNECTING)
+			return;
+
+		reopening_ = true;
+	}
+
+	/*
+	 * Opening can block for as long as a TCP connect takes to time out, so it runs unlocked. Nothing else touches the
+	 * device meanwhile: send_data() refuses to write while reconnecting and close() leaves the device to us.
+	 */
+	bool reopened = true;
+
+	try {
+		reopen_device();
+	} catch (SerialException &e) {
+		reopened = false;
+	}
+
+	mutex_lock lock(mutex_);
+
+	reopening_ = false;
+
+	// Closed while we were reopening
+	if (connection_state_ != CONNECTION_RECONNECTING) {
+		if (is_open())
+			close_device();
+		return;
+	}
+
+	if (!reopened) {
+		connection_stats_.reconnect_attempts++;
+
+		reconnect_backoff_ms_ = reconnect_backoff_ms_ * 2 < SERIAL_RECONNECT_MAX_MS ? reconnect_backoff_ms_ * 2 : SERIAL_RECONNECT_MAX_MS;
+		schedule_reconnect();
+		return;
+	}
+
+	connection_stats_.connects++;
+	connection_stats_.last_outage_us = monotonic_time_us() - disconnect_time_us_;
+	ROS_INFO("Reconnected after %.1f ms", connection_stats_.last_outage_us / 1000.0);
+
+	set_connection_state(CONNECTION_CONNECTED);
+	do_async_read();
+}
+
+Transport* create_transport(const TransportOptions &options, SerialListener * const listener) {
+	if (options.type == "serial")
+		return new Serial(options.port, options.serial, listener, options.read_size);
+	else if (options.type == "pty")
+		return new PtyTransport(listener, options.read_size);
+	else if (options.type == "udp")
+		return new UdpTransport(options.host, options.remote_port, options.local_port, listener);
+	else if (options.type == "tcp")
+		return new TcpTransport(options.host, options.remote_port, listener, options.read_size);
+	else if (options.type == "file")
+		return new FileTransport(options.file, options.replay_realtime ? options.serial.baud_rate : 0, listener, options.read_size);
+
+	throw SerialException("Unknown transport type " + options.type);
+}
+
+}
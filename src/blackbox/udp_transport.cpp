@@ -0,0 +1,68 @@
+#include <blackbox/udp_transport.h>
+#include <boost/lexical_cast.hpp>
+
+namespace blackbox {
+
+using boost::asio::ip::udp;
+
+UdpTransport::UdpTransport(const std::string &remote_host, int remote_port, int local_port, SerialListener * const listener) :
+		Transport(listener, UDP_READ_BUF_SIZE), socket_(io_service_), have_peer_(false), fixed_peer_(false) {
+	try {
+		socket_.open(udp::v4());
+		socket_.bind(udp::endpoint(udp::v4(), local_port));
+
+		if (!remote_host.empty()) {
+			udp::resolver resolver(io_service_);
+			peer_endpoint_ = *resolver.resolve(udp::resolver::query(udp::v4(), remote_host, boost::lexical_cast<std::string>(remote_port)));
+			have_peer_ = true;
+			fixed_peer_ = true;
+		}
+	} catch (boost::system::system_error &e) {
+		throw SerialException(e);
+	}
+
+	start();
+}
+
+UdpTransport::~UdpTransport() {
+	close();
+}
+
+bool UdpTransport::is_open() {
+	return socket_.is_open();
+}
+
+void UdpTransport::async_read_some(const boost::asio::mutable_buffers_1 &buffer, const IoHandler &handler) {
+	socket_.async_receive_from(buffer, sender_endpoint_,
+			boost::bind(&UdpTransport::receive_end, this, handler, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void UdpTransport::receive_end(const IoHandler &handler, const boost::system::error_code& error, size_t bytes_transferred) {
+	if (!error && !fixed_peer_) {
+		boost::lock_guard<boost::mutex> lock(peer_mutex_);
+		peer_endpoint_ = sender_endpoint_;
+		have_peer_ = true;
+	}
+
+	handler(error, bytes_transferred);
+}
+
+void UdpTransport::async_write(const WriteBuffers &buffers, const IoHandler &handler) {
+	boost::lock_guard<boost::mutex> lock(peer_mutex_);
+
+	if (!have_peer_) {
+		// Nobody to send to yet, drop the data rather than stalling the write queue
+		io_service_.post(boost::bind(handler, boost::system::error_code(), boost::asio::buffer_size(buffers)));
+		return;
+	}
+
+	// All queued slots go out as a single datagram
+	socket_.async_send_to(buffers, peer_endpoint_, handler);
+}
+
+void UdpTransport::close_device() {
+	boost::system::error_code ignored;
+	socket_.close(ignored);
+}
+
+}
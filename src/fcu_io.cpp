@@ -5,6 +5,8 @@
 
 #include <string>
 #include <stdint.h>
+#include <string.h>
+#include <boost/lexical_cast.hpp>
 #include <eigen3/Eigen/Core>
 #include <eigen3/Eigen/Dense>
 
@@ -12,10 +14,14 @@
 
 namespace fcu_io {
 
-fcuIO::fcuIO() {
+fcuIO::fcuIO() :
+		blackbox_(NULL), header_cache_hash_(0) {
 	command_sub_ = nh_.subscribe("extended_command", 1, &fcuIO::commandCallback, this);
 
 	unsaved_params_pub_ = nh_.advertise<std_msgs::Bool>("unsaved_params", 1, true);
+	connection_state_pub_ = nh_.advertise<diagnostic_msgs::DiagnosticStatus>("connection_state", 1, true);
+	diagnostics_pub_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
+	imu_pub_ = nh_.advertise<sensor_msgs::Imu>("imu/data", 1);
 
 	param_get_srv_ = nh_.advertiseService("param_get", &fcuIO::paramGetSrvCallback, this);
 	param_set_srv_ = nh_.advertiseService("param_set", &fcuIO::paramSetSrvCallback, this);
@@ -27,11 +33,37 @@ fcuIO::fcuIO() {
 	calibrate_rc_srv_ = nh_.advertiseService("calibrate_rc_trim", &fcuIO::calibrateRCTrimSrvCallback, this);
 
 	ros::NodeHandle nh_private("~");
-	std::string port = nh_private.param<std::string>("port", "/dev/ttyUSB0");
-	int baud_rate = nh_private.param<int>("baud_rate", 115200);
+	blackbox::TransportOptions transport_options;
+	transport_options.type = nh_private.param<std::string>("transport", "serial");
+	transport_options.port = nh_private.param<std::string>("port", "/dev/ttyUSB0");
+	transport_options.serial.baud_rate = nh_private.param<int>("baud_rate", 115200);
+	transport_options.serial.low_latency = nh_private.param<bool>("low_latency", false);
+	transport_options.serial.rtscts = nh_private.param<bool>("rtscts", false);
+	transport_options.serial.vmin = nh_private.param<int>("vmin", 1);
+	transport_options.serial.vtime = nh_private.param<int>("vtime", 0);
+	transport_options.host = nh_private.param<std::string>("host", "");
+	transport_options.remote_port = nh_private.param<int>("remote_port", 0);
+	transport_options.local_port = nh_private.param<int>("local_port", 0);
+	transport_options.file = nh_private.param<std::string>("file", "");
+	transport_options.replay_realtime = nh_private.param<bool>("replay_realtime", false);
+	transport_options.read_size = nh_private.param<int>("read_size", 0);
+	if (transport_options.type == "tcp" || transport_options.type == "udp")
+		blackbox_transport_name_ = transport_options.type + ":" + transport_options.host;
+	else if (transport_options.type == "file")
+		blackbox_transport_name_ = transport_options.type + ":" + transport_options.file;
+	else
+		blackbox_transport_name_ = transport_options.type + ":" + transport_options.port;
+
+	setEarlyCommit(nh_private.param<bool>("early_commit", false));
+
+	header_cache_ = nh_private.param<std::string>("header_cache", "");
+	if (!header_cache_.empty() && loadHeaderSnapshot(header_cache_.c_str())) {
+		header_cache_hash_ = headerHash();
+		ROS_INFO("Blackbox log header loaded from %s, decoding from the next I-frame", header_cache_.c_str());
+	}
 
 	try {
-		blackbox_ = new blackbox::Blackbox(port, baud_rate, this);
+		blackbox_ = new blackbox::Blackbox(transport_options, this);
 	} catch (std::exception e) {
 		ROS_FATAL("%s", e.what());
 		ros::shutdown();
@@ -40,30 +72,167 @@ fcuIO::fcuIO() {
 	std_msgs::Bool unsaved_msg;
 	unsaved_msg.data = false;
 	unsaved_params_pub_.publish(unsaved_msg);
+
+	memset(&last_transport_stats_, 0, sizeof(last_transport_stats_));
+	last_diagnostics_time_ = ros::WallTime::now();
+	diagnostics_timer_ = nh_.createTimer(ros::Duration(nh_private.param<double>("diagnostics_period", 1.0)), &fcuIO::diagnosticsTimerCallback, this);
 }
 
 fcuIO::~fcuIO() {
 	delete blackbox_;
 }
 
-void fcuIO::handle_blackbox_message(const uint8_t byte) {
-//	ROS_INFO("F %02X", byte);
-//	mavlink_attitude_t attitude;
-//	mavlink_msg_attitude_decode(&msg, &attitude);
-//
-//	fcu_common::Attitude attitude_msg;
-//	attitude_msg.header.stamp = mavrosflight_->time.get_ros_time_ms(attitude.time_boot_ms);
-//	attitude_msg.roll = attitude.roll;
-//	attitude_msg.pitch = attitude.pitch;
-//	attitude_msg.yaw = attitude.yaw;
-//	attitude_msg.p = attitude.rollspeed;
-//	attitude_msg.q = attitude.pitchspeed;
-//	attitude_msg.r = attitude.yawspeed;
-//
-//	if (attitude_pub_.getTopic().empty()) {
-//		attitude_pub_ = nh_.advertise<fcu_common::Attitude>("attitude", 1);
-//	}
-//	attitude_pub_.publish(attitude_msg);
+ros::Time fcuIO::fcTimeToRos(const blackbox::ClockSync &clock_sync, uint32_t fc_time_us, uint64_t rx_time_us) {
+	uint64_t host_time_us = clock_sync.valid() ? clock_sync.host_time(fc_time_us) : rx_time_us;
+
+	if (!host_time_us)
+		return ros::Time::now();
+
+	// ROS time is wall clock, so carry the monotonic age of the sample over to it
+	int64_t age_us = (int64_t) (blackbox::monotonic_time_us() - host_time_us);
+	return ros::Time::now() - ros::Duration(age_us / 1000000, (age_us % 1000000) * 1000);
+}
+
+void fcuIO::handle_blackbox_message(const uint8_t * const data, const size_t length, const uint64_t rx_time_us) {
+	feed(data, length, rx_time_us);
+}
+
+void fcuIO::flightLogMetadataReady() {
+	ROS_INFO("Blackbox log header received, decoding frames");
+
+	// The same header as last time is already there
+	if (!header_cache_.empty() && headerHash() != header_cache_hash_) {
+		if (saveHeaderSnapshot(header_cache_.c_str()))
+			header_cache_hash_ = headerHash();
+		else
+			ROS_WARN("Failed to save the blackbox log header to %s", header_cache_.c_str());
+	}
+}
+
+void fcuIO::flightLogFrameReady(bool frameValid, int32_t *frame, uint8_t frameType, int fieldCount, uint64_t frameOffset, int frameSize,
+		uint64_t frameStartTimeUs, uint64_t frameEndTimeUs) {
+	if (!frameValid || !frame || (frameType != 'I' && frameType != 'P'))
+		return;
+
+	const mainFieldIndexes_t &fields = mainFieldIndexes();
+
+	if (fields.gyroADC[0] < 0 || fields.accSmooth[0] < 0)
+		return;
+
+	sensor_msgs::Imu imu_msg;
+	imu_msg.header.stamp = fcTimeToRos(clockSync(), (uint32_t) frame[FLIGHT_LOG_FIELD_INDEX_TIME], frameStartTimeUs);
+
+	// No orientation estimate in the log
+	imu_msg.orientation_covariance[0] = -1;
+
+	imu_msg.angular_velocity.x = flightlogGyroToRadiansPerSecond(frame[fields.gyroADC[0]]);
+	imu_msg.angular_velocity.y = flightlogGyroToRadiansPerSecond(frame[fields.gyroADC[1]]);
+	imu_msg.angular_velocity.z = flightlogGyroToRadiansPerSecond(frame[fields.gyroADC[2]]);
+
+	imu_msg.linear_acceleration.x = flightlogAccelerationRawToGs(frame[fields.accSmooth[0]]) * 9.80665;
+	imu_msg.linear_acceleration.y = flightlogAccelerationRawToGs(frame[fields.accSmooth[1]]) * 9.80665;
+	imu_msg.linear_acceleration.z = flightlogAccelerationRawToGs(frame[fields.accSmooth[2]]) * 9.80665;
+
+	imu_pub_.publish(imu_msg);
+}
+
+void fcuIO::flightLogEventReady(flightLogEvent_t *event) {
+}
+
+static void addDiagnosticValue(diagnostic_msgs::DiagnosticStatus &status, const std::string &key, double value) {
+	diagnostic_msgs::KeyValue key_value;
+	key_value.key = key;
+	key_value.value = boost::lexical_cast<std::string>(value);
+	status.values.push_back(key_value);
+}
+
+void fcuIO::diagnosticsTimerCallback(const ros::TimerEvent &event) {
+	if (!blackbox_)
+		return;
+
+	const blackbox::TransportStats stats = blackbox_->transport_stats();
+	const ros::WallTime now = ros::WallTime::now();
+	const double period = (now - last_diagnostics_time_).toSec();
+	const blackbox::TransportStats &last = last_transport_stats_;
+
+	diagnostic_msgs::DiagnosticStatus status;
+	status.name = "fcu_io: transport";
+	status.hardware_id = blackbox_transport_name_;
+	status.level = blackbox_->connection_state() == blackbox::CONNECTION_CONNECTED ? diagnostic_msgs::DiagnosticStatus::OK : diagnostic_msgs::DiagnosticStatus::ERROR;
+	status.message = blackbox::connection_state_name(blackbox_->connection_state());
+
+	if (period > 0) {
+		addDiagnosticValue(status, "rx_bytes_per_second", (stats.rx_bytes - last.rx_bytes) / period);
+		addDiagnosticValue(status, "tx_bytes_per_second", (stats.tx_bytes - last.tx_bytes) / period);
+		addDiagnosticValue(status, "reads_per_second", (stats.read_count - last.read_count) / period);
+		addDiagnosticValue(status, "writes_per_second", (stats.write_count - last.write_count) / period);
+	}
+	addDiagnosticValue(status, "rx_bytes", stats.rx_bytes);
+	addDiagnosticValue(status, "tx_bytes", stats.tx_bytes);
+	addDiagnosticValue(status, "reads", stats.read_count);
+	addDiagnosticValue(status, "writes", stats.write_count);
+
+	// Reads over the last period by size, a host that can't keep up shows as a shift towards full buffers
+	for (int i = 0; i < TRANSPORT_READ_HISTOGRAM_BUCKETS; i++) {
+		addDiagnosticValue(status, "reads_" + boost::lexical_cast<std::string>(1 << i) + (i == TRANSPORT_READ_HISTOGRAM_BUCKETS - 1 ? "+" : "") + "_bytes",
+				stats.read_histogram[i] - last.read_histogram[i]);
+	}
+
+	addDiagnosticValue(status, "write_queue_depth", stats.write_queue_depth);
+	addDiagnosticValue(status, "write_queue_max_depth", stats.write_queue_max_depth);
+	if (stats.write_latency_count > last.write_latency_count) {
+		addDiagnosticValue(status, "write_latency_mean_us",
+				(double) (stats.write_latency_sum_us - last.write_latency_sum_us) / (stats.write_latency_count - last.write_latency_count));
+	}
+	addDiagnosticValue(status, "write_latency_max_us", stats.write_latency_max_us);
+	addDiagnosticValue(status, "rx_ring_high_water_mark", stats.rx_high_water_mark);
+	addDiagnosticValue(status, "rx_ring_overflows", stats.rx_overflow_count);
+
+	if (stats.rx_overflow_count != last.rx_overflow_count && status.level == diagnostic_msgs::DiagnosticStatus::OK) {
+		status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+		status.message = "decoder falling behind, receive ring overflowed";
+	}
+
+	diagnostic_msgs::DiagnosticArray array;
+	array.header.stamp = ros::Time::now();
+	array.status.push_back(status);
+	diagnostics_pub_.publish(array);
+
+	last_transport_stats_ = stats;
+	last_diagnostics_time_ = now;
+}
+
+void fcuIO::handle_connection_changed(const blackbox::ConnectionState state, const blackbox::ConnectionStats &stats) {
+	// Whatever the FC sent while the link was down is lost
+	if (state != blackbox::CONNECTION_CONNECTED)
+		streamDiscontinuity();
+
+	diagnostic_msgs::DiagnosticStatus status;
+	status.name = "fcu_io: connection";
+	status.hardware_id = blackbox_transport_name_;
+	status.message = blackbox::connection_state_name(state);
+	switch (state) {
+	case blackbox::CONNECTION_CONNECTED:
+		status.level = diagnostic_msgs::DiagnosticStatus::OK;
+		break;
+	case blackbox::CONNECTION_RECONNECTING:
+		status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+		break;
+	default:
+		status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+	}
+
+	status.values.resize(4);
+	status.values[0].key = "connects";
+	status.values[0].value = boost::lexical_cast<std::string>(stats.connects);
+	status.values[1].key = "disconnects";
+	status.values[1].value = boost::lexical_cast<std::string>(stats.disconnects);
+	status.values[2].key = "reconnect_attempts";
+	status.values[2].value = boost::lexical_cast<std::string>(stats.reconnect_attempts);
+	status.values[3].key = "last_outage_ms";
+	status.values[3].value = boost::lexical_cast<std::string>(stats.last_outage_us / 1000.0);
+
+	connection_state_pub_.publish(status);
 }
 
 //void fcuIO::on_new_param_received(std::string name, double value)
@@ -0,0 +1,268 @@
+#ifndef BLACKBOX_TEST_ENCODERS_H
+#define BLACKBOX_TEST_ENCODERS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include <blackbox/parser_input_stream.h>
+
+namespace blackbox_test {
+
+/**
+ * Writes blackbox encodings, the inverse of the scalar decoders, to build test data and logs from known values.
+ */
+class LogWriter {
+public:
+	LogWriter() :
+			bitBuffer_(0), bitCount_(0) {
+	}
+
+	const std::string& data() const {
+		return data_;
+	}
+
+	void writeString(const std::string &s) {
+		data_ += s;
+	}
+
+	void writeByte(uint8_t byte) {
+		data_ += (char) byte;
+	}
+
+	void writeUnsignedVB(uint32_t value) {
+		while (value > 0x7F) {
+			writeByte((uint8_t) (value | 0x80));
+			value >>= 7;
+		}
+		writeByte((uint8_t) value);
+	}
+
+	void writeSignedVB(int32_t value) {
+		writeUnsignedVB(zigzagEncode(value));
+	}
+
+	/**
+	 * A TAG8_8SVB group of valueCount fields. A single field is written as a bare signed VB, otherwise a header byte has a
+	 * bit set for each non-zero value. extraLanes sets more header bits past valueCount, followed by large values that
+	 * would stand out wherever they were stored (the group is still read as 8 values whatever its size).
+	 */
+	void writeTag8_8SVB(const int32_t *values, int valueCount, uint8_t extraLanes = 0) {
+		uint8_t header = extraLanes;
+
+		if (valueCount == 1) {
+			writeSignedVB(values[0]);
+			return;
+		}
+
+		for (int i = 0; i < valueCount; i++)
+			if (values[i])
+				header |= 1 << i;
+
+		writeByte(header);
+
+		for (int i = 0; i < 8; i++, header >>= 1)
+			if (header & 0x01)
+				writeSignedVB(i < valueCount ? values[i] : 0x7FFFFF00 + i);
+	}
+
+	void writeTag2_3S32(const int32_t *values) {
+		int32_t largest = 0;
+
+		for (int i = 0; i < 3; i++) {
+			const int32_t magnitude = values[i] < 0 ? -values[i] - 1 : values[i];
+
+			if (magnitude > largest)
+				largest = magnitude;
+		}
+
+		if (largest < 2) {
+			writeByte((values[0] & 0x03) << 4 | (values[1] & 0x03) << 2 | (values[2] & 0x03));
+		} else if (largest < 8) {
+			writeByte(0x40 | (values[0] & 0x0F));
+			writeByte((values[1] & 0x0F) << 4 | (values[2] & 0x0F));
+		} else if (largest < 32) {
+			writeByte(0x80 | (values[0] & 0x3F));
+			writeByte(values[1] & 0x3F);
+			writeByte(values[2] & 0x3F);
+		} else {
+			int bytes[3];
+			uint8_t selector = 0xC0;
+
+			for (int i = 0; i < 3; i++) {
+				bytes[i] = byteLength(values[i]);
+				selector |= (bytes[i] - 1) << (i * 2);
+			}
+
+			writeByte(selector);
+
+			for (int i = 0; i < 3; i++)
+				for (int b = 0; b < bytes[i]; b++)
+					writeByte((uint8_t) ((uint32_t) values[i] >> (b * 8)));
+		}
+	}
+
+	/**
+	 * TAG8_4S16 as of data version 1, where a pair of 4-bit fields shares a byte. Values must fit in 16 bits.
+	 */
+	void writeTag8_4S16_v1(const int32_t *values) {
+		uint8_t selector = 0;
+		std::string fields;
+
+		for (int i = 0; i < 4; i++) {
+			if (values[i] == 0)
+				continue;
+
+			if (i < 3 && fitsBits(values[i], 4) && fitsBits(values[i + 1], 4) && values[i + 1] != 0) {
+				selector |= 1 << (i * 2);
+				fields += (char) ((values[i] & 0x0F) | (values[i + 1] & 0x0F) << 4);
+				i++;
+			} else if (fitsBits(values[i], 8)) {
+				selector |= 2 << (i * 2);
+				fields += (char) values[i];
+			} else {
+				selector |= 3 << (i * 2);
+				fields += (char) values[i];
+				fields += (char) (values[i] >> 8);
+			}
+		}
+
+		writeByte(selector);
+		writeString(fields);
+	}
+
+	/**
+	 * TAG8_4S16 as of data version 2, nibble packed big-endian fields. Values must fit in 16 bits.
+	 */
+	void writeTag8_4S16_v2(const int32_t *values) {
+		uint8_t selector = 0;
+
+		for (int i = 0; i < 4; i++) {
+			if (values[i] == 0)
+				continue;
+			selector |= (fitsBits(values[i], 4) ? 1 : fitsBits(values[i], 8) ? 2 : 3) << (i * 2);
+		}
+
+		writeByte(selector);
+
+		for (int i = 0; i < 4; i++) {
+			static const int fieldBits[4] = { 0, 4, 8, 16 };
+			const int bits = fieldBits[(selector >> (i * 2)) & 0x03];
+
+			if (bits)
+				writeBits((uint32_t) values[i] & ((1U << bits) - 1), bits);
+		}
+
+		byteAlign();
+	}
+
+	void writeEliasDeltaU32(uint32_t value) {
+		const uint32_t code = value >= 0xFFFFFFFE ? 0xFFFFFFFF : value + 1;
+		const int length = bitLength(code) - 1;
+		const int lengthBits = bitLength(length + 1) - 1;
+
+		writeBits(0, lengthBits);
+		writeBits(length + 1, lengthBits + 1);
+		writeBits(code & ((1ULL << length) - 1), length);
+
+		// The largest code is an escape, followed by a bit to tell the two largest values apart
+		if (code == 0xFFFFFFFF)
+			writeBits(value == 0xFFFFFFFF, 1);
+	}
+
+	void writeEliasDeltaS32(int32_t value) {
+		writeEliasDeltaU32(zigzagEncode(value));
+	}
+
+	void writeEliasGammaU32(uint32_t value) {
+		const uint32_t code = value >= 0xFFFFFFFE ? 0xFFFFFFFF : value + 1;
+		const int length = bitLength(code);
+
+		writeBits(0, length);
+		writeBits(code, length);
+
+		if (code == 0xFFFFFFFF)
+			writeBits(value == 0xFFFFFFFF, 1);
+	}
+
+	void writeEliasGammaS32(int32_t value) {
+		writeEliasGammaU32(zigzagEncode(value));
+	}
+
+	/**
+	 * Write the low count bits of bits, most significant first. Bytes are only written once complete.
+	 */
+	void writeBits(uint64_t bits, int count) {
+		while (count > 0) {
+			bitBuffer_ = bitBuffer_ << 1 | (uint32_t) ((bits >> --count) & 1);
+
+			if (++bitCount_ == 8) {
+				writeByte((uint8_t) bitBuffer_);
+				bitBuffer_ = 0;
+				bitCount_ = 0;
+			}
+		}
+	}
+
+	/**
+	 * Write the last bits written, padded with zeros to a whole byte.
+	 */
+	void byteAlign() {
+		if (bitCount_ > 0)
+			writeBits(0, 8 - bitCount_);
+	}
+
+	static uint32_t zigzagEncode(int32_t value) {
+		return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+	}
+
+	static bool fitsBits(int32_t value, int bits) {
+		return value >= -(1 << (bits - 1)) && value < (1 << (bits - 1));
+	}
+
+private:
+	std::string data_;
+	uint32_t bitBuffer_;
+	int bitCount_;
+
+	static int bitLength(uint32_t value) {
+		return value ? 32 - __builtin_clz(value) : 0;
+	}
+
+	static int byteLength(int32_t value) {
+		return fitsBits(value, 8) ? 1 : fitsBits(value, 16) ? 2 : fitsBits(value, 24) ? 3 : 4;
+	}
+};
+
+/**
+ * Hands the stream its data a few bytes at a time, so that decoders never find a whole value in the window and take
+ * their scalar paths.
+ */
+class ChunkedSource: public blackbox::ParserInputSource {
+public:
+	ChunkedSource(const std::string &data, size_t chunkSize) :
+			data_(data), chunkSize_(chunkSize), pos_(0) {
+	}
+
+	bool nextChunk(const uint8_t **data, size_t *length, uint64_t *rxTimeUs) {
+		if (pos_ >= data_.size())
+			return false;
+
+		*data = (const uint8_t*) data_.data() + pos_;
+		*length = data_.size() - pos_ < chunkSize_ ? data_.size() - pos_ : chunkSize_;
+		*rxTimeUs = 0;
+		pos_ += *length;
+
+		return true;
+	}
+
+private:
+	const std::string &data_;
+	size_t chunkSize_;
+	size_t pos_;
+};
+
+}
+
+#endif
@@ -0,0 +1,188 @@
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <stdint.h>
+
+#include <blackbox/clock_sync.h>
+
+namespace {
+
+// One sample per main frame
+#define FRAME_INTERVAL_US 1000
+// The latency that every sample has, the jitter only ever adds to it
+#define BASE_LATENCY_US 3000
+#define JITTER_US 1500
+// Well within the convergence of a 50 ms bucket window
+#define TOLERANCE_US 250
+
+/**
+ * A flight controller whose clock runs at its own offset and rate against the host clock, sending its samples over a
+ * link with a fixed latency plus random jitter.
+ */
+class SimulatedLink {
+public:
+	SimulatedLink(uint64_t hostAtBoot, double driftPpm) :
+			hostAtBoot_(hostAtBoot), hostPerFc_(1.0 - driftPpm * 1e-6), fcTime_(0), random_(1) {
+	}
+
+	uint32_t fcTime() const {
+		return fcTime_;
+	}
+
+	/**
+	 * The host time at which the FC clock read fcTime, the quantity the model estimates up to the base latency.
+	 */
+	double hostTime(uint32_t fcTime) const {
+		return hostAtBoot_ + fcTime * hostPerFc_;
+	}
+
+	/**
+	 * The earliest a sample taken at fcTime can arrive, which is what the model converges on.
+	 */
+	double earliestArrival(uint32_t fcTime) const {
+		return hostTime(fcTime) + BASE_LATENCY_US;
+	}
+
+	/**
+	 * Move on to the next frame and return the host time its sample arrives at, delayed by extraDelayUs on top of
+	 * the usual latency.
+	 */
+	uint64_t nextFrame(uint64_t extraDelayUs = 0) {
+		fcTime_ += FRAME_INTERVAL_US;
+		random_ = random_ * 1103515245 + 12345;
+
+		return (uint64_t) floor(earliestArrival(fcTime_) + (random_ >> 16) % JITTER_US + extraDelayUs);
+	}
+
+	/**
+	 * The FC reboots: its clock starts over from zero, now.
+	 */
+	void reboot() {
+		hostAtBoot_ = hostTime(fcTime_) + 5000000;
+		fcTime_ = 0;
+	}
+
+private:
+	double hostAtBoot_;
+	double hostPerFc_;
+	uint32_t fcTime_;
+	uint32_t random_;
+};
+
+/**
+ * Send the next frame's sample over the link.
+ */
+bool sendFrame(blackbox::ClockSync &clockSync, SimulatedLink &link, uint64_t extraDelayUs = 0) {
+	const uint64_t arrival = link.nextFrame(extraDelayUs);
+
+	return clockSync.add_sample(link.fcTime(), arrival);
+}
+
+void expectConverged(const blackbox::ClockSync &clockSync, const SimulatedLink &link) {
+	ASSERT_TRUE(clockSync.valid());
+
+	// At the latest sample, and a second either side of it
+	for (int64_t offset = -1000000; offset <= 1000000; offset += 1000000) {
+		const uint32_t fcTime = link.fcTime() + offset;
+
+		SCOPED_TRACE(offset);
+		EXPECT_NEAR(link.earliestArrival(fcTime), (double) clockSync.host_time(fcTime), TOLERANCE_US);
+	}
+}
+
+}
+
+TEST(ClockSyncTest, ConvergesOnOffsetAndDrift) {
+	blackbox::ClockSync clockSync;
+	SimulatedLink link(1000000000000ULL, 80);
+
+	EXPECT_FALSE(clockSync.valid());
+	EXPECT_EQ(0U, clockSync.host_time(0));
+
+	for (int i = 0; i < 60000; i++)
+		ASSERT_TRUE(sendFrame(clockSync, link));
+
+	expectConverged(clockSync, link);
+	EXPECT_NEAR(80, clockSync.drift_ppm(), 5);
+
+	// The spread of the jitter, which is uniform
+	EXPECT_NEAR(JITTER_US / sqrt(12.0), clockSync.jitter_us(), JITTER_US / sqrt(12.0) / 2);
+	EXPECT_EQ(60000U, clockSync.accepted_count());
+	EXPECT_EQ(0U, clockSync.rejected_count());
+	EXPECT_EQ(0U, clockSync.reset_count());
+}
+
+TEST(ClockSyncTest, RejectsDelayedSamples) {
+	blackbox::ClockSync clockSync;
+	SimulatedLink link(1000000000000ULL, -120);
+	uint32_t delayed = 0;
+
+	for (int i = 0; i < 60000; i++) {
+		// Now and then a sample is held up far beyond the jitter, as by a buffered burst
+		const bool delay = i > 0 && i % 37 == 0;
+
+		EXPECT_EQ(!delay, sendFrame(clockSync, link, delay ? 20000 : 0)) << "sample " << i;
+
+		if (delay)
+			delayed++;
+	}
+
+	expectConverged(clockSync, link);
+	EXPECT_NEAR(-120, clockSync.drift_ppm(), 5);
+	EXPECT_EQ(delayed, clockSync.rejected_count());
+	EXPECT_EQ(60000 - delayed, clockSync.accepted_count());
+	EXPECT_EQ(0U, clockSync.reset_count());
+}
+
+TEST(ClockSyncTest, LastingLatencyStepReseeds) {
+	blackbox::ClockSync clockSync;
+	SimulatedLink link(1000000000000ULL, 30);
+
+	for (int i = 0; i < 20000; i++)
+		sendFrame(clockSync, link);
+
+	// The link stalls and every sample from now on arrives a second late
+	for (int i = 0; i < CLOCK_SYNC_MAX_CONSECUTIVE_REJECTS - 1; i++)
+		EXPECT_FALSE(sendFrame(clockSync, link, 1000000));
+
+	EXPECT_EQ(0U, clockSync.reset_count());
+	EXPECT_TRUE(sendFrame(clockSync, link, 1000000));
+	EXPECT_EQ(1U, clockSync.reset_count());
+
+	for (int i = 0; i < 20000; i++)
+		sendFrame(clockSync, link, 1000000);
+
+	// The sample that the model starts over from counts as rejected by the old model too
+	EXPECT_EQ((uint32_t) CLOCK_SYNC_MAX_CONSECUTIVE_REJECTS, clockSync.rejected_count());
+	EXPECT_NEAR(link.earliestArrival(link.fcTime()) + 1000000, (double) clockSync.host_time(link.fcTime()), TOLERANCE_US);
+}
+
+TEST(ClockSyncTest, BackwardFcTimeReseeds) {
+	blackbox::ClockSync clockSync;
+	SimulatedLink link(1000000000000ULL, 50);
+
+	for (int i = 0; i < 20000; i++)
+		sendFrame(clockSync, link);
+
+	expectConverged(clockSync, link);
+
+	// The FC restarts, so its time goes back to near zero while the host clock carries on
+	link.reboot();
+	EXPECT_TRUE(sendFrame(clockSync, link));
+	EXPECT_EQ(1U, clockSync.reset_count());
+
+	// Followed from the first sample, and converged again once the drift has been measured anew
+	EXPECT_NEAR(link.earliestArrival(link.fcTime()), (double) clockSync.host_time(link.fcTime()), JITTER_US);
+
+	for (int i = 0; i < 20000; i++)
+		ASSERT_TRUE(sendFrame(clockSync, link));
+
+	expectConverged(clockSync, link);
+	EXPECT_NEAR(50, clockSync.drift_ppm(), 5);
+	EXPECT_EQ(1U, clockSync.reset_count());
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,399 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <blackbox/decoders.h>
+#include <blackbox/parser_input_stream.h>
+
+#include "blackbox_encoders.h"
+
+namespace {
+
+using blackbox_test::ChunkedSource;
+using blackbox_test::LogWriter;
+
+#define VALUE_COUNT 20000
+
+/**
+ * Random values of every bit length from 0 to 32, so that every length of every encoding comes up.
+ */
+class RandomValues {
+public:
+	RandomValues() :
+			state_(2463534242U) {
+	}
+
+	uint32_t next() {
+		state_ ^= state_ << 13;
+		state_ ^= state_ >> 17;
+		state_ ^= state_ << 5;
+
+		return state_;
+	}
+
+	uint32_t nextUnsigned() {
+		const int bits = next() % 33;
+
+		return bits ? next() >> (32 - bits) : 0;
+	}
+
+	int32_t nextSigned() {
+		const uint32_t magnitude = nextUnsigned() >> 1;
+
+		return next() & 1 ? -(int32_t) magnitude - 1 : (int32_t) magnitude;
+	}
+
+	/**
+	 * A value that fits in a signed field of the given width.
+	 */
+	int32_t nextSigned(int bits) {
+		return (int32_t) next() >> (32 - bits);
+	}
+
+private:
+	uint32_t state_;
+};
+
+std::vector<uint32_t> unsignedValues() {
+	RandomValues random;
+	std::vector<uint32_t> values;
+
+	// The largest two share a code told apart by an escape bit
+	values.push_back(0);
+	values.push_back(0xFFFFFFFE);
+	values.push_back(0xFFFFFFFF);
+	values.push_back(0x7FFFFFFF);
+
+	while (values.size() < VALUE_COUNT)
+		values.push_back(random.nextUnsigned());
+
+	return values;
+}
+
+std::vector<int32_t> signedValues() {
+	RandomValues random;
+	std::vector<int32_t> values;
+
+	values.push_back(0);
+	values.push_back(INT32_MIN);
+	values.push_back(INT32_MAX);
+	values.push_back(-1);
+
+	while (values.size() < VALUE_COUNT)
+		values.push_back(random.nextSigned());
+
+	return values;
+}
+
+/**
+ * Decodes every value of a stream, which the encoded data must be read up to the end of.
+ */
+class Decoding {
+public:
+	virtual void decode(blackbox::ParserInputStream &pis) = 0;
+
+	virtual ~Decoding() {
+	}
+};
+
+/**
+ * Decode data through a stream over the whole of it, where the decoders take their fast paths all but at the very
+ * end, and fed in chunks too short for them. All must read exactly the encoded data.
+ */
+void decodeEveryWay(const std::string &data, Decoding &decoding) {
+	static const size_t CHUNK_SIZES[] = { 1, 7 };
+
+	{
+		SCOPED_TRACE("whole");
+		blackbox::ParserInputStream pis((const uint8_t*) data.data(), data.size());
+
+		decoding.decode(pis);
+		EXPECT_FALSE(pis.streamEof());
+		EXPECT_EQ(data.size(), pis.streamOffset());
+	}
+
+	for (size_t i = 0; i < sizeof(CHUNK_SIZES) / sizeof(*CHUNK_SIZES); i++) {
+		SCOPED_TRACE(CHUNK_SIZES[i]);
+		ChunkedSource source(data, CHUNK_SIZES[i]);
+		blackbox::ParserInputStream pis(source);
+
+		decoding.decode(pis);
+		EXPECT_FALSE(pis.streamEof());
+		EXPECT_EQ(data.size(), pis.streamOffset());
+	}
+}
+
+template<typename T>
+class ValueDecoding: public Decoding {
+public:
+	typedef T (*Decoder)(blackbox::ParserInputStream &pis);
+
+	ValueDecoding(Decoder decoder, const std::vector<T> &expected) :
+			decoder_(decoder), expected_(expected) {
+	}
+
+	void decode(blackbox::ParserInputStream &pis) {
+		for (size_t i = 0; i < expected_.size(); i++)
+			ASSERT_EQ(expected_[i], decoder_(pis)) << "value " << i;
+
+		pis.streamByteAlign();
+	}
+
+private:
+	Decoder decoder_;
+	const std::vector<T> &expected_;
+};
+
+typedef void (*GroupDecoder)(blackbox::ParserInputStream &pis, int32_t *values);
+
+/**
+ * Decodes tagged groups of groupSize values. Decoders may store more values than the group has, those are ignored.
+ */
+class GroupDecoding: public Decoding {
+public:
+	GroupDecoding(GroupDecoder decoder, int groupSize, const std::vector<int32_t> &expected) :
+			decoder_(decoder), groupSize_(groupSize), expected_(expected) {
+	}
+
+	void decode(blackbox::ParserInputStream &pis) {
+		for (size_t i = 0; i < expected_.size(); i += groupSize_) {
+			int32_t values[8];
+
+			decoder_(pis, values);
+
+			for (int j = 0; j < groupSize_; j++)
+				ASSERT_EQ(expected_[i + j], values[j]) << "group " << i / groupSize_ << " value " << j;
+		}
+	}
+
+private:
+	GroupDecoder decoder_;
+	int groupSize_;
+	const std::vector<int32_t> &expected_;
+};
+
+template<int ValueCount>
+void readTag8_8SVB(blackbox::ParserInputStream &pis, int32_t *values) {
+	streamReadTag8_8SVB(pis, values, ValueCount);
+}
+
+/**
+ * Groups of groupSize values, each group all within one of the given field widths so that every layout of the
+ * encoding is used, and now and then zero.
+ */
+std::vector<int32_t> groupValues(int groupSize, const int *widths, int widthCount) {
+	RandomValues random;
+	std::vector<int32_t> values;
+
+	while (values.size() < VALUE_COUNT) {
+		const int width = widths[random.next() % widthCount];
+
+		for (int i = 0; i < groupSize; i++)
+			values.push_back(random.next() % 4 == 0 ? 0 : random.nextSigned(width));
+	}
+
+	return values;
+}
+
+uint32_t readUnsignedVB(blackbox::ParserInputStream &pis) {
+	return pis.streamReadUnsignedVB();
+}
+
+int32_t readSignedVB(blackbox::ParserInputStream &pis) {
+	return pis.streamReadSignedVB();
+}
+
+}
+
+TEST(DecodersTest, BitsOfEveryWidth) {
+	RandomValues random;
+	std::vector<int> widths;
+	std::vector<uint32_t> values;
+	LogWriter log;
+
+	for (int i = 0; i < VALUE_COUNT; i++) {
+		const int width = random.next() % 33;
+
+		widths.push_back(width);
+		values.push_back(width ? random.next() >> (32 - width) : 0);
+		log.writeBits(values.back(), width);
+
+		// Now and then drop the rest of a byte, as before a byte aligned field
+		if (random.next() % 8 == 0) {
+			widths.push_back(-1);
+			values.push_back(0);
+			log.byteAlign();
+		}
+	}
+	log.byteAlign();
+
+	class BitsDecoding: public Decoding {
+	public:
+		BitsDecoding(const std::vector<int> &widths, const std::vector<uint32_t> &values) :
+				widths_(widths), values_(values) {
+		}
+
+		void decode(blackbox::ParserInputStream &pis) {
+			for (size_t i = 0; i < widths_.size(); i++) {
+				if (widths_[i] < 0)
+					pis.streamByteAlign();
+				else
+					ASSERT_EQ(values_[i], pis.streamReadBits(widths_[i])) << "value " << i;
+			}
+
+			pis.streamByteAlign();
+		}
+
+	private:
+		const std::vector<int> &widths_;
+		const std::vector<uint32_t> &values_;
+	} decoding(widths, values);
+
+	decodeEveryWay(log.data(), decoding);
+}
+
+TEST(DecodersTest, UnsignedVB) {
+	const std::vector<uint32_t> values = unsignedValues();
+	LogWriter log;
+
+	for (size_t i = 0; i < values.size(); i++)
+		log.writeUnsignedVB(values[i]);
+
+	ValueDecoding<uint32_t> decoding(readUnsignedVB, values);
+	decodeEveryWay(log.data(), decoding);
+}
+
+TEST(DecodersTest, SignedVB) {
+	const std::vector<int32_t> values = signedValues();
+	LogWriter log;
+
+	for (size_t i = 0; i < values.size(); i++)
+		log.writeSignedVB(values[i]);
+
+	ValueDecoding<int32_t> decoding(readSignedVB, values);
+	decodeEveryWay(log.data(), decoding);
+}
+
+TEST(DecodersTest, EliasDeltaU32) {
+	const std::vector<uint32_t> values = unsignedValues();
+	LogWriter log;
+
+	for (size_t i = 0; i < values.size(); i++)
+		log.writeEliasDeltaU32(values[i]);
+	log.byteAlign();
+
+	ValueDecoding<uint32_t> decoding(streamReadEliasDeltaU32, values);
+	decodeEveryWay(log.data(), decoding);
+}
+
+TEST(DecodersTest, EliasDeltaS32) {
+	const std::vector<int32_t> values = signedValues();
+	LogWriter log;
+
+	for (size_t i = 0; i < values.size(); i++)
+		log.writeEliasDeltaS32(values[i]);
+	log.byteAlign();
+
+	ValueDecoding<int32_t> decoding(streamReadEliasDeltaS32, values);
+	decodeEveryWay(log.data(), decoding);
+}
+
+TEST(DecodersTest, EliasGammaU32) {
+	const std::vector<uint32_t> values = unsignedValues();
+	LogWriter log;
+
+	for (size_t i = 0; i < values.size(); i++)
+		log.writeEliasGammaU32(values[i]);
+	log.byteAlign();
+
+	ValueDecoding<uint32_t> decoding(streamReadEliasGammaU32, values);
+	decodeEveryWay(log.data(), decoding);
+}
+
+TEST(DecodersTest, EliasGammaS32) {
+	const std::vector<int32_t> values = signedValues();
+	LogWriter log;
+
+	for (size_t i = 0; i < values.size(); i++)
+		log.writeEliasGammaS32(values[i]);
+	log.byteAlign();
+
+	ValueDecoding<int32_t> decoding(streamReadEliasGammaS32, values);
+	decodeEveryWay(log.data(), decoding);
+}
+
+TEST(DecodersTest, Tag2_3S32) {
+	static const int WIDTHS[] = { 2, 4, 6, 8, 16, 24, 32 };
+	RandomValues random;
+	std::vector<int32_t> values = groupValues(3, WIDTHS, sizeof(WIDTHS) / sizeof(*WIDTHS));
+	LogWriter log;
+
+	// And groups of mixed width, in which each field is stored in as many bytes as it needs
+	for (int i = 0; i < 3 * VALUE_COUNT; i++)
+		values.push_back(random.nextSigned(WIDTHS[random.next() % 7]));
+
+	for (size_t i = 0; i < values.size(); i += 3)
+		log.writeTag2_3S32(&values[i]);
+
+	GroupDecoding decoding(streamReadTag2_3S32, 3, values);
+	decodeEveryWay(log.data(), decoding);
+}
+
+TEST(DecodersTest, Tag8_4S16_v1) {
+	static const int WIDTHS[] = { 4, 8, 16 };
+	RandomValues random;
+	std::vector<int32_t> values;
+	LogWriter log;
+
+	// Each field of its own width, so that 4-bit pairs start at every field
+	for (int i = 0; i < 4 * VALUE_COUNT; i++)
+		values.push_back(random.next() % 4 == 0 ? 0 : random.nextSigned(WIDTHS[random.next() % 3]));
+
+	for (size_t i = 0; i < values.size(); i += 4)
+		log.writeTag8_4S16_v1(&values[i]);
+
+	GroupDecoding decoding(streamReadTag8_4S16_v1, 4, values);
+	decodeEveryWay(log.data(), decoding);
+}
+
+TEST(DecodersTest, Tag8_4S16_v2) {
+	static const int WIDTHS[] = { 4, 8, 16 };
+	RandomValues random;
+	std::vector<int32_t> values;
+	LogWriter log;
+
+	// Each field of its own width, so that fields start on either nibble
+	for (int i = 0; i < 4 * VALUE_COUNT; i++)
+		values.push_back(random.next() % 4 == 0 ? 0 : random.nextSigned(WIDTHS[random.next() % 3]));
+
+	for (size_t i = 0; i < values.size(); i += 4)
+		log.writeTag8_4S16_v2(&values[i]);
+
+	GroupDecoding decoding(streamReadTag8_4S16_v2, 4, values);
+	decodeEveryWay(log.data(), decoding);
+}
+
+TEST(DecodersTest, Tag8_8SVB) {
+	// Mostly values of 1-2 bytes, which the vector decoder takes, with some of up to 5
+	static const int WIDTHS[] = { 7, 14, 7, 14, 7, 14, 32 };
+	static const GroupDecoder DECODERS[] = { readTag8_8SVB<1>, readTag8_8SVB<2>, readTag8_8SVB<3>, readTag8_8SVB<4>,
+			readTag8_8SVB<5>, readTag8_8SVB<6>, readTag8_8SVB<7>, readTag8_8SVB<8> };
+
+	for (int groupSize = 1; groupSize <= 8; groupSize++) {
+		SCOPED_TRACE(groupSize);
+		const std::vector<int32_t> values = groupValues(groupSize, WIDTHS, sizeof(WIDTHS) / sizeof(*WIDTHS));
+		LogWriter log;
+
+		for (size_t i = 0; i < values.size(); i += groupSize)
+			log.writeTag8_8SVB(&values[i], groupSize);
+
+		GroupDecoding decoding(DECODERS[groupSize - 1], groupSize, values);
+		decodeEveryWay(log.data(), decoding);
+	}
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
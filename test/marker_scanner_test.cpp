@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <blackbox/marker_scanner.h>
+
+namespace {
+
+/**
+ * Long enough for two full 16-byte blocks of the vectorised search plus a byte-at-a-time tail.
+ */
+#define BUFFER_LENGTH 40
+
+blackbox::MarkerScanner frameMarkers() {
+	blackbox::MarkerScanner scanner;
+
+	scanner.addMarker('I');
+	scanner.addMarker('P');
+	scanner.addMarker('E');
+
+	return scanner;
+}
+
+/**
+ * A buffer of bytes that are none of the markers.
+ */
+std::string plainBuffer() {
+	return std::string(BUFFER_LENGTH, 'x');
+}
+
+TEST(MarkerScannerTest, NoMarkerReturnsTheLength) {
+	blackbox::MarkerScanner scanner = frameMarkers();
+	std::string buffer = plainBuffer();
+
+	for (size_t length = 0; length <= buffer.size(); length++)
+		EXPECT_EQ(length, scanner.find((const uint8_t*) buffer.data(), length));
+}
+
+TEST(MarkerScannerTest, MarkerEitherSideOfABlockBoundary) {
+	blackbox::MarkerScanner scanner = frameMarkers();
+
+	// The last byte of the first block, then the first byte of the second
+	for (size_t position = 15; position <= 16; position++) {
+		std::string buffer = plainBuffer();
+
+		buffer[position] = 'P';
+		EXPECT_EQ(position, scanner.find((const uint8_t*) buffer.data(), buffer.size()));
+
+		// Cut off just before the marker, the search must not read past the end to find it
+		EXPECT_EQ(position, scanner.find((const uint8_t*) buffer.data(), position));
+	}
+
+	// A block that ends in a plain byte must not hide a marker at the start of the next
+	std::string buffer = plainBuffer();
+
+	buffer[16] = 'I';
+	buffer[17] = 'E';
+	EXPECT_EQ(16U, scanner.find((const uint8_t*) buffer.data(), buffer.size()));
+}
+
+TEST(MarkerScannerTest, FindsTheFirstMarkerFromAnyStart) {
+	blackbox::MarkerScanner scanner = frameMarkers();
+
+	// Every alignment of the blocks against the marker, including markers left for the tail
+	for (size_t start = 0; start < 16; start++) {
+		for (size_t position = start; position < BUFFER_LENGTH; position++) {
+			std::string buffer = plainBuffer();
+
+			buffer[position] = 'E';
+			if (position + 1 < buffer.size())
+				buffer[position + 1] = 'I';
+
+			EXPECT_EQ(position - start, scanner.find((const uint8_t*) buffer.data() + start, buffer.size() - start))
+				<< "start " << start << ", marker at " << position;
+		}
+	}
+}
+
+TEST(MarkerScannerTest, OnlyTheAddedMarkersMatch) {
+	blackbox::MarkerScanner scanner;
+	std::string buffer = plainBuffer();
+
+	scanner.addMarker('H');
+
+	buffer[3] = 'I';
+	buffer[20] = 'H';
+	EXPECT_EQ(20U, scanner.find((const uint8_t*) buffer.data(), buffer.size()));
+}
+
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,823 @@
+#include <gtest/gtest.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <blackbox/parser.h>
+
+#include "blackbox_encoders.h"
+
+namespace {
+
+using blackbox_test::LogWriter;
+
+#define MAIN_FRAME_INTERVAL 32
+#define MAIN_FRAME_TIME_STEP 1000
+
+struct DecodedFrame {
+	bool valid;
+	uint8_t type;
+	std::vector<int32_t> fields;
+};
+
+/**
+ * Keeps every frame the parser passes on.
+ */
+class RecordingParser: public blackbox::Parser {
+public:
+	std::vector<DecodedFrame> frames;
+
+	explicit RecordingParser(blackbox::ParserInputStream &pis) :
+			Parser(pis) {
+	}
+
+	RecordingParser() {
+	}
+
+	void flightLogMetadataReady() {
+	}
+
+	void flightLogFrameReady(bool frameValid, int32_t *frame, uint8_t frameType, int fieldCount, uint64_t frameOffset, int frameSize,
+			uint64_t frameStartTimeUs, uint64_t frameEndTimeUs) {
+		DecodedFrame decoded;
+
+		(void) frameOffset;
+		(void) frameSize;
+		(void) frameStartTimeUs;
+		(void) frameEndTimeUs;
+
+		decoded.valid = frameValid;
+		decoded.type = frameType;
+
+		if (frame)
+			decoded.fields.assign(frame, frame + fieldCount);
+
+		frames.push_back(decoded);
+	}
+
+	void flightLogEventReady(flightLogEvent_t *event) {
+		(void) event;
+	}
+};
+
+/**
+ * Builds a log from field definitions and the values stored in each frame, along with the frames the parser should
+ * make of it. Predictions are limited to none, the previous main frame and the iteration increment.
+ */
+class TestLog {
+public:
+	std::vector<DecodedFrame> expected;
+
+	TestLog() :
+			homeSeen_(false), random_(1) {
+		log_.writeString("H Product:Blackbox flight data recorder by Nicholas Sherlock\n");
+		log_.writeString("H Data version:2\n");
+		writeHeaderLine("I interval", MAIN_FRAME_INTERVAL);
+		log_.writeString("H P interval:1/1\n");
+	}
+
+	const std::string& data() const {
+		return log_.data();
+	}
+
+	/**
+	 * Define the fields of a frame type, P frames share the names of I frames. More names or attributes than the
+	 * parser keeps may be given, fieldCount is the number the frames have.
+	 */
+	void define(uint8_t type, int fieldCount, const std::vector<std::string> &names, const std::vector<int> &predictor,
+			const std::vector<int> &encoding) {
+		FrameDef &def = defs_[type];
+
+		def.fieldCount = fieldCount;
+		def.predictor = predictor;
+		def.encoding = encoding;
+
+		if (!names.empty())
+			writeHeaderLine(type, "name", join(names));
+		writeHeaderLine(type, "predictor", join(predictor));
+		writeHeaderLine(type, "encoding", join(encoding));
+	}
+
+	/**
+	 * Define I and P frames of fieldCount fields: the iteration and time, then SIGNED_VB fields predicted from the
+	 * previous frame in P frames, with encodings that differ from that given by encoding (indexed by field).
+	 */
+	void defineMainFrames(int fieldCount, const std::map<int, int> &encoding) {
+		std::vector<std::string> names;
+		std::vector<int> intraPredictor, intraEncoding, interPredictor, interEncoding;
+
+		for (int i = 0; i < fieldCount; i++) {
+			std::map<int, int>::const_iterator special = encoding.find(i);
+			std::ostringstream name;
+
+			if (i == FLIGHT_LOG_FIELD_INDEX_ITERATION)
+				name << "loopIteration";
+			else if (i == FLIGHT_LOG_FIELD_INDEX_TIME)
+				name << "time";
+			else
+				name << "f" << i;
+
+			names.push_back(name.str());
+			intraPredictor.push_back(FLIGHT_LOG_FIELD_PREDICTOR_0);
+			interPredictor.push_back(i == FLIGHT_LOG_FIELD_INDEX_ITERATION ? FLIGHT_LOG_FIELD_PREDICTOR_INC : FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS);
+
+			if (i <= FLIGHT_LOG_FIELD_INDEX_TIME) {
+				intraEncoding.push_back(FLIGHT_LOG_FIELD_ENCODING_UNSIGNED_VB);
+				interEncoding.push_back(i == FLIGHT_LOG_FIELD_INDEX_ITERATION ? FLIGHT_LOG_FIELD_ENCODING_NULL : FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB);
+			} else {
+				const int fieldEncoding = special != encoding.end() ? special->second : FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB;
+
+				intraEncoding.push_back(fieldEncoding);
+				interEncoding.push_back(fieldEncoding);
+			}
+		}
+
+		define('I', fieldCount < FLIGHT_LOG_MAX_FIELDS ? fieldCount : FLIGHT_LOG_MAX_FIELDS, names, intraPredictor, intraEncoding);
+		define('P', defs_['I'].fieldCount, std::vector<std::string>(), interPredictor, interEncoding);
+	}
+
+	/**
+	 * Define a frame type of fieldCount SIGNED_VB fields without predictions, but for the encodings given by field.
+	 */
+	void defineUnpredictedFrame(uint8_t type, int fieldCount, const std::map<int, int> &encoding) {
+		std::vector<std::string> names;
+		std::vector<int> predictor, fieldEncoding;
+
+		for (int i = 0; i < fieldCount; i++) {
+			std::map<int, int>::const_iterator special = encoding.find(i);
+			std::ostringstream name;
+
+			name << (char) tolower(type) << i;
+			names.push_back(name.str());
+			predictor.push_back(FLIGHT_LOG_FIELD_PREDICTOR_0);
+			fieldEncoding.push_back(special != encoding.end() ? special->second : FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB);
+		}
+
+		define(type, fieldCount, names, predictor, fieldEncoding);
+	}
+
+	/**
+	 * Write the main frame of the given iteration, an I-frame every MAIN_FRAME_INTERVAL iterations, with small random
+	 * values.
+	 */
+	void writeMainFrame(uint32_t iteration) {
+		const bool intra = iteration % MAIN_FRAME_INTERVAL == 0;
+		std::vector<int32_t> stored = randomValues(defs_['I'].fieldCount);
+
+		stored[FLIGHT_LOG_FIELD_INDEX_ITERATION] = intra ? iteration : 0;
+		stored[FLIGHT_LOG_FIELD_INDEX_TIME] = intra ? iteration * MAIN_FRAME_TIME_STEP : MAIN_FRAME_TIME_STEP;
+
+		writeFrame(intra ? 'I' : 'P', stored);
+	}
+
+	/**
+	 * Bytes that aren't part of any frame, which the parser should skip.
+	 */
+	void writeGarbage(const std::string &bytes) {
+		log_.writeString(bytes);
+	}
+
+	/**
+	 * A frame of the given type of small random values.
+	 */
+	void writeRandomFrame(uint8_t type) {
+		writeFrame(type, randomValues(defs_[type].fieldCount));
+	}
+
+	/**
+	 * Write a frame that stores the given values, and expect the frame they predict.
+	 */
+	void writeFrame(uint8_t type, const std::vector<int32_t> &stored) {
+		const FrameDef &def = defs_[type];
+		DecodedFrame frame;
+		int i = 0;
+
+		log_.writeByte(type);
+
+		while (i < def.fieldCount) {
+			int32_t group[8];
+			int groupCount = 0;
+
+			if (def.predictor[i] == FLIGHT_LOG_FIELD_PREDICTOR_INC) {
+				i++;
+				continue;
+			}
+
+			switch (def.encoding[i]) {
+			case FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB:
+				log_.writeSignedVB(stored[i]);
+				break;
+			case FLIGHT_LOG_FIELD_ENCODING_UNSIGNED_VB:
+				log_.writeUnsignedVB(stored[i]);
+				break;
+			case FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB:
+				while (groupCount < 8 && i + groupCount < def.fieldCount && def.encoding[i + groupCount] == FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB)
+					groupCount++;
+
+				// Groups short of 8 values also set the header bits of the values they don't have
+				log_.writeTag8_8SVB(&stored[i], groupCount, (uint8_t) (0xFF << groupCount));
+				break;
+			case FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32:
+				groupCount = 3;
+				fillGroup(stored, i, groupCount, group);
+				log_.writeTag2_3S32(group);
+				break;
+			case FLIGHT_LOG_FIELD_ENCODING_TAG8_4S16:
+				groupCount = 4;
+				fillGroup(stored, i, groupCount, group);
+				log_.writeTag8_4S16_v2(group);
+				break;
+			default:
+				;
+			}
+
+			i += groupCount > 0 ? groupCount : 1;
+		}
+
+		frame.type = type;
+		frame.valid = type != 'G' || homeSeen_;
+
+		for (i = 0; i < def.fieldCount; i++) {
+			const int32_t previous = type == 'P' ? lastMain_[i] : 0;
+
+			if (def.encoding[i] == FLIGHT_LOG_FIELD_ENCODING_NULL)
+				frame.fields.push_back(def.predictor[i] == FLIGHT_LOG_FIELD_PREDICTOR_INC ? previous + 1 : 0);
+			else if (def.predictor[i] == FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS)
+				frame.fields.push_back(previous + stored[i]);
+			else
+				frame.fields.push_back(stored[i]);
+		}
+
+		if (type == 'I' || type == 'P')
+			lastMain_ = frame.fields;
+		else if (type == 'H')
+			homeSeen_ = true;
+
+		expected.push_back(frame);
+	}
+
+private:
+	struct FrameDef {
+		int fieldCount;
+		std::vector<int> predictor;
+		std::vector<int> encoding;
+	};
+
+	LogWriter log_;
+	std::map<uint8_t, FrameDef> defs_;
+	std::vector<int32_t> lastMain_;
+	bool homeSeen_;
+	uint32_t random_;
+
+	std::vector<int32_t> randomValues(int count) {
+		std::vector<int32_t> values;
+
+		for (int i = 0; i < count; i++) {
+			random_ = random_ * 1103515245 + 12345;
+			values.push_back((int32_t) ((random_ >> 16) % 81) - 40);
+		}
+
+		return values;
+	}
+
+	// The values of a tag group, which may run past the end of the frame into values that are never stored
+	static void fillGroup(const std::vector<int32_t> &stored, int first, int count, int32_t *group) {
+		for (int i = 0; i < count; i++)
+			group[i] = first + i < (int) stored.size() ? stored[first + i] : -7 + i;
+	}
+
+	void writeHeaderLine(const char *name, int value) {
+		std::ostringstream line;
+
+		line << "H " << name << ":" << value << "\n";
+		log_.writeString(line.str());
+	}
+
+	void writeHeaderLine(uint8_t type, const char *attribute, const std::string &value) {
+		std::ostringstream line;
+
+		line << "H Field " << type << " " << attribute << ":" << value << "\n";
+		log_.writeString(line.str());
+	}
+
+	template<typename T>
+	static std::string join(const std::vector<T> &values) {
+		std::ostringstream joined;
+
+		for (size_t i = 0; i < values.size(); i++)
+			joined << (i ? "," : "") << values[i];
+
+		return joined.str();
+	}
+};
+
+void expectFrames(const std::vector<DecodedFrame> &expected, const std::vector<DecodedFrame> &frames) {
+	ASSERT_EQ(expected.size(), frames.size());
+
+	for (size_t i = 0; i < expected.size(); i++) {
+		SCOPED_TRACE(i);
+
+		ASSERT_EQ(expected[i].type, frames[i].type);
+		ASSERT_EQ(expected[i].valid, frames[i].valid);
+		ASSERT_EQ(expected[i].fields, frames[i].fields);
+	}
+}
+
+/**
+ * Like expectFrames(), but what the frames reported as invalid hold is of no interest.
+ */
+void expectValidFrames(const std::vector<DecodedFrame> &expected, const std::vector<DecodedFrame> &frames) {
+	ASSERT_EQ(expected.size(), frames.size());
+
+	for (size_t i = 0; i < expected.size(); i++) {
+		SCOPED_TRACE(i);
+
+		ASSERT_EQ(expected[i].type, frames[i].type);
+		ASSERT_EQ(expected[i].valid, frames[i].valid);
+
+		if (expected[i].valid) {
+			ASSERT_EQ(expected[i].fields, frames[i].fields);
+		}
+	}
+}
+
+DecodedFrame invalidFrame(uint8_t type) {
+	DecodedFrame frame;
+
+	frame.valid = false;
+	frame.type = type;
+
+	return frame;
+}
+
+/**
+ * Feed data[begin, end) a few bytes at a time.
+ */
+void feedRange(blackbox::Parser &parser, const std::string &data, size_t begin, size_t end) {
+	for (size_t pos = begin; pos < end; pos += 7)
+		parser.feed((const uint8_t*) data.data() + pos, std::min((size_t) 7, end - pos));
+}
+
+/**
+ * A file name for a header snapshot, removed again when done with.
+ */
+class TempFile {
+public:
+	TempFile() {
+		char path[] = "/tmp/blackbox_parser_test_XXXXXX";
+		int fd = mkstemp(path);
+
+		if (fd >= 0)
+			close(fd);
+
+		path_ = path;
+	}
+
+	~TempFile() {
+		remove(path_.c_str());
+	}
+
+	const char* path() const {
+		return path_.c_str();
+	}
+
+	std::string read() const {
+		std::ifstream file(path_.c_str());
+		std::ostringstream contents;
+
+		contents << file.rdbuf();
+
+		return contents.str();
+	}
+
+	void write(const std::string &contents) const {
+		std::ofstream file(path_.c_str(), std::ios::trunc);
+
+		file << contents;
+	}
+
+private:
+	std::string path_;
+};
+
+/**
+ * Parse the log pulled from memory, which leaves the decoders the whole log to decode from.
+ */
+void expectParsed(const TestLog &log) {
+	blackbox::ParserInputStream pis((const uint8_t*) log.data().data(), log.data().size());
+	RecordingParser parser(pis);
+
+	ASSERT_TRUE(parser.parse(false));
+	expectFrames(log.expected, parser.frames);
+}
+
+/**
+ * Parse the log fed a few bytes at a time, so that values are often cut short by the end of a chunk.
+ */
+void expectFed(const TestLog &log, size_t chunkSize) {
+	RecordingParser parser;
+
+	for (size_t pos = 0; pos < log.data().size(); pos += chunkSize)
+		parser.feed((const uint8_t*) log.data().data() + pos, std::min(chunkSize, log.data().size() - pos));
+
+	parser.feedEnd();
+	expectFrames(log.expected, parser.frames);
+}
+
+}
+
+TEST(ParserTest, Tag8_8SVBGroupAtTheEndOfAFullWidthMainFrame) {
+	TestLog log;
+	std::map<int, int> encoding;
+
+	// A whole group of 8, then one of 2 whose header also flags the 6 values after the end of the frame
+	for (int i = 2; i < 10; i++)
+		encoding[i] = FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB;
+	encoding[FLIGHT_LOG_MAX_FIELDS - 2] = FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB;
+	encoding[FLIGHT_LOG_MAX_FIELDS - 1] = FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB;
+
+	log.defineMainFrames(FLIGHT_LOG_MAX_FIELDS, encoding);
+
+	for (uint32_t iteration = 0; iteration < 4 * MAIN_FRAME_INTERVAL; iteration++)
+		log.writeMainFrame(iteration);
+
+	expectParsed(log);
+	expectFed(log, 7);
+}
+
+TEST(ParserTest, FullWidthDefinitionsOfEveryFrameType) {
+	TestLog log;
+	std::map<int, int> mainEncoding, gpsEncoding, homeEncoding, slowEncoding;
+
+	// More names than are kept, the last two fields kept start a TAG8_4S16 group that runs past the end
+	mainEncoding[FLIGHT_LOG_MAX_FIELDS - 2] = FLIGHT_LOG_FIELD_ENCODING_TAG8_4S16;
+	log.defineMainFrames(FLIGHT_LOG_MAX_FIELDS + 32, mainEncoding);
+
+	// Every other frame type ends in a short group, which would overwrite whatever follows its frame buffer
+	for (int i = FLIGHT_LOG_MAX_FIELDS - 3; i < FLIGHT_LOG_MAX_FIELDS; i++)
+		gpsEncoding[i] = FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB;
+	log.defineUnpredictedFrame('G', FLIGHT_LOG_MAX_FIELDS, gpsEncoding);
+
+	for (int i = FLIGHT_LOG_MAX_FIELDS - 8; i < FLIGHT_LOG_MAX_FIELDS - 2; i++)
+		homeEncoding[i] = FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB;
+	homeEncoding[FLIGHT_LOG_MAX_FIELDS - 2] = FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32;
+	log.defineUnpredictedFrame('H', FLIGHT_LOG_MAX_FIELDS, homeEncoding);
+
+	slowEncoding[FLIGHT_LOG_MAX_FIELDS - 5] = FLIGHT_LOG_FIELD_ENCODING_TAG2_3S32;
+	slowEncoding[FLIGHT_LOG_MAX_FIELDS - 2] = FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB;
+	slowEncoding[FLIGHT_LOG_MAX_FIELDS - 1] = FLIGHT_LOG_FIELD_ENCODING_TAG8_8SVB;
+	log.defineUnpredictedFrame('S', FLIGHT_LOG_MAX_FIELDS, slowEncoding);
+
+	for (uint32_t iteration = 0; iteration < 4 * MAIN_FRAME_INTERVAL; iteration++) {
+		log.writeMainFrame(iteration);
+
+		if (iteration % MAIN_FRAME_INTERVAL == 0)
+			log.writeRandomFrame('H');
+		if (iteration % 4 == 1)
+			log.writeRandomFrame('G');
+
+		// The state of the last main frame is kept after the slow frame, and the next I-frame is checked against it
+		if (iteration % MAIN_FRAME_INTERVAL == MAIN_FRAME_INTERVAL - 1)
+			log.writeRandomFrame('S');
+	}
+
+	expectParsed(log);
+	expectFed(log, 7);
+}
+
+TEST(ParserTest, StrayIntraframeMarkerAfterAGap) {
+	TestLog log;
+	std::vector<size_t> frameStarts;
+	LogWriter stray;
+	RecordingParser parser;
+	std::vector<DecodedFrame> expected;
+	const uint32_t gapStart = MAIN_FRAME_INTERVAL + 5, gapEnd = 2 * MAIN_FRAME_INTERVAL - 10;
+
+	log.defineMainFrames(8, std::map<int, int>());
+
+	for (uint32_t iteration = 0; iteration < 5 * MAIN_FRAME_INTERVAL; iteration++) {
+		frameStarts.push_back(log.data().size());
+		log.writeMainFrame(iteration);
+	}
+
+	// An 'I' in the garbage after the gap that decodes to an I-frame far in the future, followed by a real P-frame
+	stray.writeByte('I');
+	stray.writeUnsignedVB(0x10000000);
+	stray.writeUnsignedVB(0x10000000);
+	for (int i = 2; i < 8; i++)
+		stray.writeSignedVB(0);
+
+	feedRange(parser, log.data(), 0, frameStarts[gapStart]);
+	parser.streamDiscontinuity();
+	feedRange(parser, stray.data(), 0, stray.data().size());
+	feedRange(parser, log.data(), frameStarts[gapEnd], log.data().size());
+	parser.feedEnd();
+
+	// The last frame before the gap was never confirmed by the marker of the next one
+	expected.assign(log.expected.begin(), log.expected.begin() + gapStart - 1);
+
+	// Nothing after the gap is trusted until the second real I-frame agrees with the first
+	expected.push_back(invalidFrame('I'));
+	for (uint32_t iteration = gapEnd; iteration < 3 * MAIN_FRAME_INTERVAL; iteration++)
+		expected.push_back(invalidFrame(log.expected[iteration].type));
+	expected.insert(expected.end(), log.expected.begin() + 3 * MAIN_FRAME_INTERVAL, log.expected.end());
+
+	expectValidFrames(expected, parser.frames);
+}
+
+TEST(ParserTest, RetractedFramesDontReachTheClockModel) {
+	TestLog log;
+	std::vector<size_t> frameStarts;
+	RecordingParser parser;
+	const uint32_t corruptIteration = MAIN_FRAME_INTERVAL + 8;
+	uint32_t confirmedMainFrames = 0;
+
+	log.defineMainFrames(8, std::map<int, int>());
+
+	for (uint32_t iteration = 0; iteration < 3 * MAIN_FRAME_INTERVAL; iteration++) {
+		frameStarts.push_back(log.data().size());
+
+		if (iteration == corruptIteration) {
+			// Decodes fine, but isn't followed by a marker. Zeros, so that no marker is found inside it either.
+			log.writeFrame('P', std::vector<int32_t>(8, 0));
+			log.writeGarbage("\x01");
+		} else {
+			log.writeMainFrame(iteration);
+		}
+	}
+	frameStarts.push_back(log.data().size());
+
+	parser.setEarlyCommit(true);
+	parser.feed((const uint8_t*) log.data().data(), frameStarts[0]);
+
+	// Each frame arrives on time for the FC clock, as it would from a link with no latency at all
+	for (uint32_t iteration = 0; iteration < 3 * MAIN_FRAME_INTERVAL; iteration++)
+		parser.feed((const uint8_t*) log.data().data() + frameStarts[iteration], frameStarts[iteration + 1] - frameStarts[iteration],
+				1000000 + iteration * MAIN_FRAME_TIME_STEP);
+	parser.feedEnd();
+
+	for (size_t i = 0; i < parser.frames.size(); i++) {
+		if (!parser.frames[i].valid)
+			continue;
+
+		// The corrupt frame is passed on, then retracted by the report that follows
+		if (i + 1 < parser.frames.size() && !parser.frames[i + 1].valid && parser.frames[i + 1].fields.empty())
+			continue;
+
+		confirmedMainFrames++;
+	}
+
+	// The corrupt frame and the P-frames that follow it up to the next I-frame are lost
+	EXPECT_EQ(3 * MAIN_FRAME_INTERVAL - (2 * MAIN_FRAME_INTERVAL - corruptIteration), confirmedMainFrames);
+	EXPECT_EQ(confirmedMainFrames, parser.clockSync().accepted_count() + parser.clockSync().rejected_count());
+}
+
+TEST(ParserTest, ResyncAfterGarbageBetweenFrames) {
+	TestLog log;
+	std::vector<size_t> frameStarts;
+	std::vector<DecodedFrame> expected;
+	LogWriter strayIntraframe;
+	const uint32_t firstGarbage = 10, secondGarbage = MAIN_FRAME_INTERVAL + 8;
+
+	// Far beyond the iteration and time of the frames around it, and not followed by a marker
+	strayIntraframe.writeByte('I');
+	strayIntraframe.writeUnsignedVB(0x10000000);
+	strayIntraframe.writeUnsignedVB(0x10000000);
+
+	log.defineMainFrames(8, std::map<int, int>());
+
+	for (uint32_t iteration = 0; iteration < 3 * MAIN_FRAME_INTERVAL; iteration++) {
+		frameStarts.push_back(log.data().size());
+
+		if (iteration == firstGarbage || iteration == secondGarbage) {
+			// Zeros, so that the only marker the search can stop at in the frame and the garbage is the stray 'I'
+			log.writeFrame('P', std::vector<int32_t>(8, 0));
+
+			if (iteration == firstGarbage)
+				log.writeGarbage("\x01\x02\x03\x04\x05");
+			else
+				log.writeGarbage("\x01" + strayIntraframe.data() + "\x02\x03");
+
+			// Cut short by the garbage after it, the main stream then waits for the next I-frame
+			expected.push_back(invalidFrame('P'));
+		} else {
+			log.writeMainFrame(iteration);
+
+			if ((iteration > firstGarbage && iteration < MAIN_FRAME_INTERVAL) || (iteration > secondGarbage && iteration < 2 * MAIN_FRAME_INTERVAL))
+				expected.push_back(invalidFrame('P'));
+			else
+				expected.push_back(log.expected.back());
+		}
+	}
+
+	for (int fed = 0; fed < 2; fed++) {
+		SCOPED_TRACE(fed ? "fed" : "parsed");
+		blackbox::ParserInputStream pis((const uint8_t*) log.data().data(), log.data().size());
+		RecordingParser pulled(pis), pushed;
+		RecordingParser &parser = fed ? pushed : pulled;
+
+		parser.setStatsLevel(blackbox::Parser::STATS_COUNTERS);
+
+		if (fed) {
+			feedRange(parser, log.data(), 0, log.data().size());
+			parser.feedEnd();
+		} else {
+			ASSERT_TRUE(parser.parse(false));
+		}
+
+		expectValidFrames(expected, parser.frames);
+
+		// Each search starts from the second byte of the cut short frame and ends at the next frame
+		const blackbox::Parser::flightLogStatistics_t &stats = parser.stats();
+
+		EXPECT_EQ(2U, stats.resyncCount);
+		EXPECT_EQ(frameStarts[firstGarbage + 1] - frameStarts[firstGarbage] - 1 + frameStarts[secondGarbage + 1] - frameStarts[secondGarbage] - 1,
+				stats.resyncBytesSkipped);
+		EXPECT_EQ(1U, stats.resyncRejectedIntraframes);
+		EXPECT_EQ(2U, stats.totalCorruptFrames);
+	}
+}
+
+TEST(ParserTest, HeaderSnapshotAttachesMidLog) {
+	TestLog log;
+	TempFile snapshot;
+	std::vector<size_t> frameStarts;
+	RecordingParser saver, attached;
+	const uint32_t attachIteration = MAIN_FRAME_INTERVAL + 8;
+
+	log.defineMainFrames(8, std::map<int, int>());
+
+	for (uint32_t iteration = 0; iteration < 4 * MAIN_FRAME_INTERVAL; iteration++) {
+		frameStarts.push_back(log.data().size());
+		log.writeMainFrame(iteration);
+	}
+
+	// Nothing to save before the header has been read
+	EXPECT_FALSE(saver.saveHeaderSnapshot(snapshot.path()));
+
+	feedRange(saver, log.data(), 0, frameStarts[1]);
+	ASSERT_TRUE(saver.saveHeaderSnapshot(snapshot.path()));
+
+	// A restart that comes back part way through an interval
+	ASSERT_TRUE(attached.loadHeaderSnapshot(snapshot.path()));
+	EXPECT_EQ(saver.headerHash(), attached.headerHash());
+
+	feedRange(attached, log.data(), frameStarts[attachIteration], log.data().size());
+	attached.feedEnd();
+
+	ASSERT_EQ(log.expected.size() - attachIteration, attached.frames.size());
+
+	for (size_t i = 0; i < attached.frames.size(); i++) {
+		const uint32_t iteration = attachIteration + i;
+		const DecodedFrame &frame = attached.frames[i];
+
+		SCOPED_TRACE(iteration);
+
+		ASSERT_EQ(log.expected[iteration].type, frame.type);
+
+		// The P-frames before the next I-frame have nothing to be predicted from
+		if (iteration < 2 * MAIN_FRAME_INTERVAL) {
+			EXPECT_FALSE(frame.valid);
+			continue;
+		}
+
+		// Decoded from the next I-frame on, and trusted once the I-frame after it agrees, as after a gap
+		EXPECT_EQ(iteration >= 3 * MAIN_FRAME_INTERVAL, frame.valid);
+		EXPECT_EQ(log.expected[iteration].fields, frame.fields);
+	}
+}
+
+TEST(ParserTest, HeaderSnapshotOfAnotherHeaderIsRefused) {
+	TestLog log;
+	TempFile snapshot;
+	RecordingParser saver, attached;
+	std::string contents;
+	size_t interval;
+
+	log.defineMainFrames(8, std::map<int, int>());
+
+	for (uint32_t iteration = 0; iteration < 2 * MAIN_FRAME_INTERVAL; iteration++)
+		log.writeMainFrame(iteration);
+
+	feedRange(saver, log.data(), 0, log.data().size());
+	ASSERT_TRUE(saver.saveHeaderSnapshot(snapshot.path()));
+
+	// A header line that no longer matches the hash the snapshot was saved with
+	contents = snapshot.read();
+	interval = contents.find("H I interval:32\n");
+	ASSERT_NE(std::string::npos, interval);
+	contents.replace(interval, strlen("H I interval:32"), "H I interval:16");
+	snapshot.write(contents);
+
+	EXPECT_FALSE(attached.loadHeaderSnapshot(snapshot.path()));
+
+	// Still waiting for a header, so the log from the start parses as usual
+	feedRange(attached, log.data(), 0, log.data().size());
+	attached.feedEnd();
+	expectFrames(log.expected, attached.frames);
+}
+
+TEST(ParserTest, UndecodableFramesAreSkipped) {
+	struct {
+		const char *name;
+		int predictor, encoding;
+		blackbox::Parser::DecodeError error;
+	} const cases[] = {
+		{ "unsupported predictor", 99, FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB, blackbox::Parser::DECODE_ERROR_UNSUPPORTED_PREDICTOR },
+		{ "unsupported encoding", FLIGHT_LOG_FIELD_PREDICTOR_0, 99, blackbox::Parser::DECODE_ERROR_UNSUPPORTED_ENCODING },
+		// The main frames have no motor[0] field to predict from
+		{ "no motor[0]", FLIGHT_LOG_FIELD_PREDICTOR_MOTOR_0, FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB, blackbox::Parser::DECODE_ERROR_NO_MOTOR_0 }
+	};
+
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		SCOPED_TRACE(cases[c].name);
+
+		TestLog log;
+		std::vector<std::string> names;
+		std::vector<int> predictor(3, FLIGHT_LOG_FIELD_PREDICTOR_0), encoding(3, FLIGHT_LOG_FIELD_ENCODING_SIGNED_VB);
+		std::vector<DecodedFrame> expected;
+		uint32_t slowFrames = 0;
+
+		names.push_back("s0");
+		names.push_back("s1");
+		names.push_back("s2");
+		predictor[1] = cases[c].predictor;
+		encoding[1] = cases[c].encoding;
+
+		log.defineMainFrames(8, std::map<int, int>());
+		log.define('S', 3, names, predictor, encoding);
+
+		for (uint32_t iteration = 0; iteration < 2 * MAIN_FRAME_INTERVAL; iteration++) {
+			log.writeMainFrame(iteration);
+			expected.push_back(log.expected.back());
+
+			if (iteration % 8 == 3) {
+				// Zeros, so that the search for the next frame from the second byte of this one stops at that frame
+				log.writeFrame('S', std::vector<int32_t>(3, 0));
+				expected.push_back(invalidFrame('S'));
+				slowFrames++;
+			}
+		}
+
+		for (int fed = 0; fed < 2; fed++) {
+			SCOPED_TRACE(fed ? "fed" : "parsed");
+			blackbox::ParserInputStream pis((const uint8_t*) log.data().data(), log.data().size());
+			RecordingParser pulled(pis), pushed;
+			RecordingParser &parser = fed ? pushed : pulled;
+
+			parser.setStatsLevel(blackbox::Parser::STATS_COUNTERS);
+
+			if (fed) {
+				feedRange(parser, log.data(), 0, log.data().size());
+				parser.feedEnd();
+			} else {
+				ASSERT_TRUE(parser.parse(false));
+			}
+
+			// Every slow frame is reported as corrupt, and the main frames around them are untouched
+			expectFrames(expected, parser.frames);
+
+			const blackbox::Parser::flightLogStatistics_t &stats = parser.stats();
+
+			for (int error = blackbox::Parser::DECODE_OK + 1; error < blackbox::Parser::DECODE_ERROR_COUNT; error++)
+				EXPECT_EQ(error == cases[c].error ? slowFrames : 0U, stats.decodeErrors[error]) << "decode error " << error;
+			EXPECT_EQ(slowFrames, stats.totalCorruptFrames);
+		}
+	}
+}
+
+TEST(ParserTest, FailsafePhaseNamesFitTheBuffer) {
+	RecordingParser parser;
+	char name[8];
+
+	parser.flightlogFailsafePhaseToString(2, name, sizeof(name));
+	EXPECT_STREQ("LANDING", name);
+
+	// A name too long for the buffer leaves it empty, a phase without a name is printed as a number cut to fit
+	parser.flightlogFailsafePhaseToString(1, name, sizeof(name));
+	EXPECT_STREQ("", name);
+	parser.flightlogFailsafePhaseToString(123, name, 3);
+	EXPECT_STREQ("12", name);
+	parser.flightlogFailsafePhaseToString(123, name, 1);
+	EXPECT_STREQ("", name);
+
+	// Nothing at all fits in an empty buffer
+	name[0] = 'x';
+	parser.flightlogFailsafePhaseToString(2, name, 0);
+	EXPECT_EQ('x', name[0]);
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}